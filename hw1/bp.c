@@ -1,88 +1,87 @@
 #include "bp_api.h"
+#include "bp_internal.h"
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+static const BP_kernel bp_kernels[2][2][3];
+static const BP_kernel bp_generic_kernel;
+
+static BP *bp = NULL; // Predictor behind the single-instance BP_* API
+
+// Function to check the configuration parameters
+static bool bp_config_valid(const BP_config *cfg) {
+    unsigned btbSize = cfg->btbSize;
+    if (btbSize == 0 || btbSize > BP_MAX_BTB_SIZE || (btbSize & (btbSize - 1))) return false;
+    unsigned ways = cfg->btbWays ? cfg->btbWays : 1;
+    if (ways > BP_MAX_BTB_WAYS || ways > btbSize || (ways & (ways - 1))) return false;
+    if (cfg->btbRepl != BP_BTB_LRU && cfg->btbRepl != BP_BTB_PLRU) return false;
+    if (cfg->historySize < 1 || cfg->historySize > 8) return false;
+    int log_num_sets = log2(btbSize / ways);
+    if (cfg->tagSize > 30 - log_num_sets) return false;
+    if (cfg->fsmState > 3) return false;
+    if (cfg->Shared != 0 && cfg->Shared != 1 && cfg->Shared != 2) return false;
+    return true;
+}
 
-// Structure representing a BTB (Branch Target Buffer) entry
-typedef struct {
-    uint32_t tag;      // Tag to identify the instruction
-    uint32_t target;   // Target address for the branch
-    uint32_t history;  // Branch history
-    uint32_t *fsm;     // Finite State Machine (FSM) states for prediction
-} BTB_entry;
-
-// Structure representing the Branch Predictor
-typedef struct {
-    BTB_entry *btb;           // Pointer to the BTB entries
-    unsigned btbSize;         // Size of the BTB
-    unsigned historySize;     // Size of the history
-    unsigned tagSize;         // Size of the tag
-    unsigned fsmState;        // Initial FSM state
-    bool isGlobalHist;        // Flag for global history
-    bool isGlobalTable;       // Flag for global FSM table
-    int Shared;               // Sharing mode
-    unsigned globalHistory;   // Global history register
-    uint32_t *globalFSM;      // Global FSM table
-    SIM_stats stats;          // Statistics for the simulation
-} BP;
+// Function to check whether a configuration uses the direct-mapped, unhashed BTB
+static bool bp_config_direct(const BP_config *cfg) {
+    return cfg->btbWays <= 1 && !cfg->btbHash;
+}
 
-static BP *bp = NULL; // Global pointer to the Branch Predictor
+// Function to calculate the theoretical size of the predictor, in bits
+unsigned bp_theoretical_size(const BP_config *cfg) {
+    unsigned target_size = 30; // Assume the size of target is 30 bits
+    unsigned num_of_fsms = cfg->isGlobalTable ? 1 : cfg->btbSize; // Number of FSMs
+    unsigned num_of_histories = cfg->isGlobalHist ? 1 : cfg->btbSize; // Number of history registers
+
+    unsigned size = 2 * pow(2, cfg->historySize) * num_of_fsms; // FSM size
+    size += cfg->historySize * num_of_histories; // History size
+    size += (cfg->tagSize + target_size + 1) * cfg->btbSize; // Entry size
+
+    // Replacement state: an age per entry for LRU, ways - 1 tree bits per set for PLRU
+    unsigned ways = cfg->btbWays ? cfg->btbWays : 1;
+    if (ways > 1 && cfg->btbRepl == BP_BTB_LRU) {
+        size += (unsigned)log2(ways) * cfg->btbSize;
+    } else if (ways > 1) {
+        size += (ways - 1) * (cfg->btbSize / ways);
+    }
+    return size;
+}
 
-// Function to initialize the Branch Predictor
-int BP_init(unsigned btbSize, unsigned historySize, unsigned tagSize, unsigned fsmState,
-            bool isGlobalHist, bool isGlobalTable, int Shared) {
+// Function to create an independent Branch Predictor
+BP_ctx *BP_create(const BP_config *cfg) {
     // Check for valid input parameters
-    if (!(btbSize == 1 || btbSize == 2 || btbSize == 4 || btbSize == 8 || btbSize == 16 || btbSize == 32)) return -1;
-    if (historySize < 1 || historySize > 8) return -1;
+    if (!cfg || !bp_config_valid(cfg)) return NULL;
+    if (!bp_config_direct(cfg)) return bp_create_assoc(cfg);
+    unsigned btbSize = cfg->btbSize;
+    unsigned historySize = cfg->historySize;
+    unsigned tagSize = cfg->tagSize;
+    unsigned fsmState = cfg->fsmState;
+    bool isGlobalHist = cfg->isGlobalHist;
+    bool isGlobalTable = cfg->isGlobalTable;
+    int Shared = cfg->Shared;
     int log_btb_size = log2(btbSize);
-    if (tagSize < 0 || tagSize > 30 - log_btb_size) return -1;
-    if (fsmState < 0 || fsmState > 3) return -1;
-    if (Shared != 0 && Shared != 1 && Shared != 2) return -1;
-
-    // Allocate memory for the Branch Predictor
-    bp = (BP *)malloc(sizeof(BP));
-    if (!bp) return -1;
-    bp->btb = (BTB_entry *)malloc(sizeof(BTB_entry) * btbSize);
-    if (!bp->btb) {
-        free(bp);
-        return -1;
-    }
-
-    // Initialize FSM table
-    if (isGlobalTable) {
-        bp->globalFSM = (uint32_t *)malloc(sizeof(uint32_t) * (1 << historySize));
-        if (!bp->globalFSM) {
-            free(bp->btb);
-            free(bp);
-            return -1;
-        }
-        for (unsigned i = 0; i < (1 << historySize); ++i) {
-            bp->globalFSM[i] = fsmState;
-        }
-    } else {
-        for (unsigned i = 0; i < btbSize; ++i) {
-            bp->btb[i].fsm = (uint32_t *)malloc(sizeof(uint32_t) * (1 << historySize));
-            if (!bp->btb[i].fsm) {
-                for (unsigned j = 0; j < i; ++j) {
-                    free(bp->btb[j].fsm);
-                }
-                free(bp->btb);
-                free(bp);
-                return -1;
-            }
-            for (unsigned j = 0; j < (1 << historySize); ++j) {
-                bp->btb[i].fsm[j] = fsmState;
-            }
-        }
-    }
 
-    // Initialize local histories if not using global history
-    if (!isGlobalHist) {
-        for (unsigned i = 0; i < btbSize; ++i) {
-            bp->btb[i].history = 0;
-            bp->btb[i].target = 0;
-        }
-    }
+    // Lay out the arena: 32-bit arrays first, then the byte-wide counters
+    unsigned tableSize = 1u << historySize;
+    unsigned num_of_fsms = isGlobalTable ? 1 : btbSize; // Number of FSM tables
+    unsigned num_of_histories = isGlobalHist ? 1 : btbSize; // Number of history registers
+    size_t words = 2 * (size_t)btbSize + num_of_histories;
+    size_t bytes = sizeof(BP) + words * sizeof(uint32_t) + (size_t)num_of_fsms * tableSize;
+
+    // Allocate the Branch Predictor and all of its tables at once
+    BP *bp = (BP *)malloc(bytes);
+    if (!bp) return NULL;
+    bp->tags = (uint32_t *)(bp + 1);
+    bp->targets = bp->tags + btbSize;
+    bp->histories = bp->targets + btbSize;
+    bp->fsm = (uint8_t *)(bp->histories + num_of_histories);
+
+    // Initialize tags, targets, histories (contexts may reuse freed heap memory) and FSMs
+    memset(bp->tags, 0, words * sizeof(uint32_t));
+    memset(bp->fsm, fsmState, (size_t)num_of_fsms * tableSize);
 
     // Set Branch Predictor parameters
     bp->btbSize = btbSize;
@@ -92,39 +91,58 @@ int BP_init(unsigned btbSize, unsigned historySize, unsigned tagSize, unsigned f
     bp->isGlobalHist = isGlobalHist;
     bp->isGlobalTable = isGlobalTable;
     bp->Shared = Shared;
-    bp->globalHistory = 0;
+    bp->tableSize = tableSize;
+    bp->btbMask = btbSize - 1;
+    bp->tagShift = 2 + log_btb_size;
+    bp->tagMask = (1u << tagSize) - 1;
+    bp->histMask = tableSize - 1;
+    bp->btbWays = 1;
+    bp->btbHash = false;
+    bp->hashMask = 0;
+    bp->histStride = isGlobalHist ? 0 : 1;
+    bp->tableStride = isGlobalTable ? 0 : tableSize;
+    bp->shareShift = Shared == 2 ? 16 : 2;
+    bp->shareMask = Shared ? bp->histMask : 0;
+    bp->ages = NULL;
+    bp->plru = NULL;
+    bp->kernel = bp_kernels[isGlobalHist][isGlobalTable][Shared];
+    bp->engine = NULL;
+    bp->profile = NULL;
+    bp->footprint = bytes;
     bp->stats.flush_num = 0;
     bp->stats.br_num = 0;
+    bp->stats.size = bp_theoretical_size(cfg);
 
-    // Calculate the size of the predictor
-    unsigned target_size = 30; // Assume the size of target is 30 bits
-    unsigned num_of_fsms = bp->isGlobalTable ? 1 : bp->btbSize; // Number of FSMs
-    unsigned num_of_histories = bp->isGlobalHist ? 1 : bp->btbSize; // Number of history registers
-
-    bp->stats.size = 2 * pow(2, bp->historySize) * num_of_fsms; // FSM size
-    bp->stats.size += bp->historySize * num_of_histories; // History size
-    bp->stats.size += (bp->tagSize + target_size + 1) * bp->btbSize; // Entry size
+    return bp;
+}
 
-    return 0;
+// Function to initialize the single-instance Branch Predictor
+int BP_init(unsigned btbSize, unsigned historySize, unsigned tagSize, unsigned fsmState,
+            bool isGlobalHist, bool isGlobalTable, int Shared) {
+    BP_config cfg = { btbSize, historySize, tagSize, fsmState, isGlobalHist, isGlobalTable, Shared };
+    if (bp) BP_destroy(bp);
+    bp = NULL;
+    if (btbSize > 32) return -1; // The BP_* API keeps its original BTB limit
+    bp = BP_create(&cfg);
+    return bp ? 0 : -1;
 }
 
-// Function to predict the branch target
-bool BP_predict(uint32_t pc, uint32_t *dst) {
+// Generic kernel: predict the branch target, checking the configuration at runtime
+static bool bp_predict_generic(BP *bp, uint32_t pc, uint32_t *dst) {
     // Calculate the BTB index
     uint32_t btbIndex = (pc >> 2) & (bp->btbSize - 1);
-    BTB_entry *entry = &bp->btb[btbIndex];
 
     // Calculate the tag
     uint32_t tag = (pc >> (2 + (int)log2(bp->btbSize))) & ((1 << bp->tagSize) - 1);
 
     // Check if the tag matches
-    if (entry->tag != tag) {
+    if (bp->tags[btbIndex] != tag) {
         *dst = pc + 4; // Default to the next sequential instruction
         return false;
     }
 
     // Determine history
-    unsigned history = bp->isGlobalHist ? bp->globalHistory : entry->history;
+    unsigned history = bp->histories[bp->isGlobalHist ? 0 : btbIndex];
 
     // Calculate the FSM index with optional sharing
     unsigned fsmIndex = history;
@@ -135,30 +153,26 @@ bool BP_predict(uint32_t pc, uint32_t *dst) {
     }
 
     // Get the current FSM state
-    int fsm_current_state;
-    if (bp->isGlobalTable) {
-        fsm_current_state = bp->globalFSM[fsmIndex];
-    } else {
-        fsm_current_state = entry->fsm[fsmIndex];
-    }
+    const uint8_t *fsm = bp->isGlobalTable ? bp->fsm : bp->fsm + btbIndex * bp->tableSize;
+    int fsm_current_state = fsm[fsmIndex];
 
     // Determine if the branch is taken based on the FSM state
     bool taken = fsm_current_state >= 2;
-    *dst = taken ? entry->target : pc + 4;
+    *dst = taken ? bp->targets[btbIndex] : pc + 4;
     return taken;
 }
 
-// Function to update the Branch Predictor after the branch outcome is known
-void BP_update(uint32_t pc, uint32_t targetPc, bool taken, uint32_t pred_dst) {
+// Generic kernel: update the Branch Predictor after the branch outcome is known
+static void bp_update_generic(BP *bp, uint32_t pc, uint32_t targetPc, bool taken, uint32_t pred_dst) {
     // Calculate the BTB index
     uint32_t btbIndex = (pc >> 2) & (bp->btbSize - 1);
-    BTB_entry *entry = &bp->btb[btbIndex];
 
     // Calculate the tag
     uint32_t tag = (pc >> (2 + (int)log2(bp->btbSize))) & ((1 << bp->tagSize) - 1);
 
     // Determine history
-    unsigned history = bp->isGlobalHist ? bp->globalHistory : entry->history;
+    uint32_t *historyReg = &bp->histories[bp->isGlobalHist ? 0 : btbIndex];
+    unsigned history = *historyReg;
 
     // Calculate the FSM index with optional sharing
     unsigned fsmIndex = history;
@@ -168,26 +182,25 @@ void BP_update(uint32_t pc, uint32_t targetPc, bool taken, uint32_t pred_dst) {
         fsmIndex ^= (pc >> 16) & ((1 << bp->historySize) - 1);
     }
 
-    bool tagMismatch = (entry->tag != tag);
+    uint8_t *fsm = bp->isGlobalTable ? bp->fsm : bp->fsm + btbIndex * bp->tableSize;
+    bool tagMismatch = (bp->tags[btbIndex] != tag);
     bool misprediction = (taken && pred_dst != targetPc) || (!taken && pred_dst != pc + 4);
 
     // Check if the tag matches or if there was a misprediction
     if (tagMismatch || misprediction) {
         // Insert new branch instruction into the BTB entry if the tag doesn't match
         if (tagMismatch) {
-            entry->tag = tag;
-            entry->target = targetPc;
+            bp->tags[btbIndex] = tag;
+            bp->targets[btbIndex] = targetPc;
 
             if (!bp->isGlobalHist) {
                 // Reset local history
-                entry->history = 0;
+                *historyReg = 0;
             }
 
             if (!bp->isGlobalTable) {
-                // Initialize local FSM to the default state
-                for (unsigned i = 0; i < (1 << bp->historySize); ++i) {
-                    entry->fsm[i] = bp->fsmState;
-                }
+                // Bulk reset of the local FSM table to the default state
+                memset(fsm, bp->fsmState, bp->tableSize);
             }
         }
 
@@ -195,12 +208,11 @@ void BP_update(uint32_t pc, uint32_t targetPc, bool taken, uint32_t pred_dst) {
         if (misprediction) {
             bp->stats.flush_num++;
             // Correct the target address in the BTB entry
-            entry->target = targetPc;
+            bp->targets[btbIndex] = targetPc;
         }
     }
 
     // Update the FSM state based on the actual outcome
-    uint32_t *fsm = bp->isGlobalTable ? bp->globalFSM : entry->fsm;
     if (taken) {
         if (fsm[fsmIndex] < 3) {
             fsm[fsmIndex]++;
@@ -212,35 +224,354 @@ void BP_update(uint32_t pc, uint32_t targetPc, bool taken, uint32_t pred_dst) {
     }
 
     // Update the history
-    history = ((history << 1) | taken) & ((1 << bp->historySize) - 1);
-    if (bp->isGlobalHist) {
-        bp->globalHistory = history;
+    *historyReg = ((history << 1) | taken) & ((1 << bp->historySize) - 1);
+
+    bp->stats.br_num++;
+}
+
+// Generic kernel: predict and update a batch of branches
+static void bp_run_generic(BP *bp, const BP_branch *br, size_t num, BP_prediction *pred) {
+    for (size_t i = 0; i < num; ++i) {
+        uint32_t dst = 0;
+        bool taken = bp_predict_generic(bp, br[i].pc, &dst);
+        if (pred) {
+            pred[i].dst = dst;
+            pred[i].taken = taken;
+        }
+        bp_update_generic(bp, br[i].pc, br[i].targetPc, br[i].taken, dst);
+    }
+}
+
+// Probe for the direct-mapped BTB, shared by all the kernels below
+static bool bp_probe_direct(const BP *bp, uint32_t pc) {
+    return bp->tags[(pc >> 2) & bp->btbMask] == ((pc >> bp->tagShift) & bp->tagMask);
+}
+
+static const BP_kernel bp_generic_kernel = { bp_predict_generic, bp_update_generic, bp_run_generic, bp_probe_direct };
+
+// Specialized kernel bodies: the configuration arguments are compile-time
+// constants at every call site below, so each instantiation carries no
+// configuration branches and uses the shifts and masks precomputed by BP_create.
+static inline unsigned bp_fsm_index(const BP *bp, uint32_t pc, unsigned history, int shared) {
+    if (shared == 1) { // Using lower bits of PC
+        return history ^ ((pc >> 2) & bp->histMask);
+    } else if (shared == 2) { // Using mid bits of PC
+        return history ^ ((pc >> 16) & bp->histMask);
+    }
+    return history;
+}
+
+static inline bool bp_predict_body(BP *bp, uint32_t pc, uint32_t *dst,
+                                   bool globalHist, bool globalTable, int shared) {
+    uint32_t btbIndex = (pc >> 2) & bp->btbMask;
+    uint32_t tag = (pc >> bp->tagShift) & bp->tagMask;
+
+    if (bp->tags[btbIndex] != tag) {
+        *dst = pc + 4;
+        return false;
+    }
+
+    unsigned history = bp->histories[globalHist ? 0 : btbIndex];
+    unsigned fsmIndex = bp_fsm_index(bp, pc, history, shared);
+    const uint8_t *fsm = globalTable ? bp->fsm : bp->fsm + btbIndex * bp->tableSize;
+
+    bool taken = fsm[fsmIndex] >= 2;
+    *dst = taken ? bp->targets[btbIndex] : pc + 4;
+    return taken;
+}
+
+static inline void bp_update_body(BP *bp, uint32_t pc, uint32_t targetPc, bool taken, uint32_t pred_dst,
+                                  bool globalHist, bool globalTable, int shared) {
+    uint32_t btbIndex = (pc >> 2) & bp->btbMask;
+    uint32_t tag = (pc >> bp->tagShift) & bp->tagMask;
+
+    uint32_t *historyReg = &bp->histories[globalHist ? 0 : btbIndex];
+    unsigned history = *historyReg;
+    unsigned fsmIndex = bp_fsm_index(bp, pc, history, shared);
+    uint8_t *fsm = globalTable ? bp->fsm : bp->fsm + btbIndex * bp->tableSize;
+
+    bool misprediction = pred_dst != (taken ? targetPc : pc + 4);
+
+    if (bp->tags[btbIndex] != tag) {
+        bp->tags[btbIndex] = tag;
+        bp->targets[btbIndex] = targetPc;
+        if (!globalHist) {
+            *historyReg = 0;
+        }
+        if (!globalTable) {
+            memset(fsm, bp->fsmState, bp->tableSize);
+        }
+    }
+    if (misprediction) {
+        bp->stats.flush_num++;
+        bp->targets[btbIndex] = targetPc;
+    }
+
+    uint8_t state = fsm[fsmIndex];
+    if (taken) {
+        fsm[fsmIndex] = state + (state < 3);
     } else {
-        entry->history = history;
+        fsm[fsmIndex] = state - (state > 0);
     }
 
+    *historyReg = ((history << 1) | taken) & bp->histMask;
     bp->stats.br_num++;
 }
 
-// Function to retrieve statistics and clean up the Branch Predictor
-void BP_GetStats(SIM_stats *curStats) {
-    if (!bp || !curStats) return;
+// Instantiate the kernels of one (history scope, table scope, share mode) combination
+#define BP_KERNEL_VARIANT(GH, GT, SH) \
+static bool bp_predict_##GH##_##GT##_##SH(BP *bp, uint32_t pc, uint32_t *dst) { \
+    return bp_predict_body(bp, pc, dst, GH, GT, SH); \
+} \
+static void bp_update_##GH##_##GT##_##SH(BP *bp, uint32_t pc, uint32_t targetPc, bool taken, uint32_t pred_dst) { \
+    bp_update_body(bp, pc, targetPc, taken, pred_dst, GH, GT, SH); \
+} \
+static void bp_run_##GH##_##GT##_##SH(BP *bp, const BP_branch *br, size_t num, BP_prediction *pred) { \
+    for (size_t i = 0; i < num; ++i) { \
+        uint32_t dst; \
+        bool taken = bp_predict_body(bp, br[i].pc, &dst, GH, GT, SH); \
+        if (pred) { \
+            pred[i].dst = dst; \
+            pred[i].taken = taken; \
+        } \
+        bp_update_body(bp, br[i].pc, br[i].targetPc, br[i].taken, dst, GH, GT, SH); \
+    } \
+}
 
-    // Retrieve the statistics
-    curStats->flush_num = bp->stats.flush_num;
-    curStats->br_num = bp->stats.br_num;
-    curStats->size = bp->stats.size;
+BP_KERNEL_VARIANT(0, 0, 0) BP_KERNEL_VARIANT(0, 0, 1) BP_KERNEL_VARIANT(0, 0, 2)
+BP_KERNEL_VARIANT(0, 1, 0) BP_KERNEL_VARIANT(0, 1, 1) BP_KERNEL_VARIANT(0, 1, 2)
+BP_KERNEL_VARIANT(1, 0, 0) BP_KERNEL_VARIANT(1, 0, 1) BP_KERNEL_VARIANT(1, 0, 2)
+BP_KERNEL_VARIANT(1, 1, 0) BP_KERNEL_VARIANT(1, 1, 1) BP_KERNEL_VARIANT(1, 1, 2)
+
+#define BP_KERNEL_ENTRY(GH, GT, SH) \
+    { bp_predict_##GH##_##GT##_##SH, bp_update_##GH##_##GT##_##SH, bp_run_##GH##_##GT##_##SH, bp_probe_direct }
+
+// Dispatch table, indexed [isGlobalHist][isGlobalTable][Shared]
+static const BP_kernel bp_kernels[2][2][3] = {
+    { { BP_KERNEL_ENTRY(0, 0, 0), BP_KERNEL_ENTRY(0, 0, 1), BP_KERNEL_ENTRY(0, 0, 2) },
+      { BP_KERNEL_ENTRY(0, 1, 0), BP_KERNEL_ENTRY(0, 1, 1), BP_KERNEL_ENTRY(0, 1, 2) } },
+    { { BP_KERNEL_ENTRY(1, 0, 0), BP_KERNEL_ENTRY(1, 0, 1), BP_KERNEL_ENTRY(1, 0, 2) },
+      { BP_KERNEL_ENTRY(1, 1, 0), BP_KERNEL_ENTRY(1, 1, 1), BP_KERNEL_ENTRY(1, 1, 2) } },
+};
+
+// Function to predict the branch target
+bool BP_ctx_predict(BP_ctx *bp, uint32_t pc, uint32_t *dst) {
+    return bp->kernel.predict(bp, pc, dst);
+}
+
+// Function to update the Branch Predictor after the branch outcome is known
+void BP_ctx_update(BP_ctx *bp, uint32_t pc, uint32_t targetPc, bool taken, uint32_t pred_dst) {
+    bp->kernel.update(bp, pc, targetPc, taken, pred_dst);
+}
+
+// Function to predict and update a batch of branches
+void BP_ctx_run(BP_ctx *bp, const BP_branch *br, size_t num, BP_prediction *pred) {
+    bp->kernel.run(bp, br, num, pred);
+}
+
+// Function to switch between the specialized kernels and the generic one
+void BP_ctx_use_generic(BP_ctx *bp, bool generic) {
+    if (bp->engine || bp->btbWays > 1 || bp->btbHash) return; // Engines and associative BTBs have a single kernel
+    BP_kernel kernel = generic ? bp_generic_kernel
+                               : bp_kernels[bp->isGlobalHist][bp->isGlobalTable][bp->Shared];
+    bp_set_kernel(bp, &kernel);
+}
+
+// Lockstep multi-configuration engine
+//
+// Configurations with the same BTB geometry (btbSize, tagSize) allocate and
+// replace BTB entries identically, since a tag miss depends only on the trace.
+// BP_multi therefore keeps a single tag array and decodes each branch (index,
+// tag, hit) once; only targets, histories and FSM tables are per
+// configuration. Each configuration is a lane whose scope and share mode are
+// turned into strides and masks, so the per-lane step has no configuration
+// branches. The only per-lane branch left is the local-table reset, and it
+// runs only on a tag miss, which is shared by every lane.
+
+// Per-configuration state of a lockstep engine
+typedef struct {
+    uint32_t *targets;        // BTB targets of this configuration
+    uint32_t *histories;      // History registers (histStride 0: a single global one)
+    uint8_t *fsm;             // FSM tables (tableStride 0: a single global one)
+    unsigned histStride;      // History register step per BTB entry (0 or 1)
+    unsigned tableStride;     // FSM table step per BTB entry (0 or tableSize)
+    unsigned tableSize;       // Number of FSMs in a single table
+    unsigned histMask;        // History mask
+    unsigned shareShift;      // PC shift of the share bits (2 lsb, 16 mid)
+    unsigned shareMask;       // Share bits mask (0 when not using share)
+    unsigned fsmState;        // Initial FSM state
+    SIM_stats stats;          // Statistics of this configuration
+} BP_lane;
+
+struct BP_multi {
+    unsigned num;             // Number of configurations
+    unsigned btbMask;         // BTB index mask
+    unsigned tagShift;        // PC shift to the tag bits
+    uint32_t tagMask;         // Tag mask
+    uint32_t *tags;           // BTB tags, shared by all configurations
+    BP_lane *lanes;           // One lane per configuration
+    void *arena;              // Targets, histories and FSM tables of all lanes
+};
+
+// Function to create a lockstep engine for configurations sharing btbSize and tagSize
+BP_multi *BP_multi_create(const BP_config *cfgs, unsigned num) {
+    if (!cfgs || num == 0) return NULL;
+    for (unsigned c = 0; c < num; ++c) {
+        if (!bp_config_valid(&cfgs[c]) || !bp_config_direct(&cfgs[c])) return NULL;
+        if (cfgs[c].btbSize != cfgs[0].btbSize || cfgs[c].tagSize != cfgs[0].tagSize) return NULL;
+    }
+    unsigned btbSize = cfgs[0].btbSize;
+
+    // Size the arena: per lane targets, then histories, then byte-wide FSMs
+    size_t words = btbSize, bytes = 0;
+    for (unsigned c = 0; c < num; ++c) {
+        words += btbSize + (cfgs[c].isGlobalHist ? 1 : btbSize);
+        bytes += (size_t)(cfgs[c].isGlobalTable ? 1 : btbSize) << cfgs[c].historySize;
+    }
+
+    BP_multi *m = (BP_multi *)malloc(sizeof(BP_multi));
+    if (!m) return NULL;
+    m->lanes = (BP_lane *)malloc(sizeof(BP_lane) * num);
+    m->arena = malloc(words * sizeof(uint32_t) + bytes);
+    if (!m->lanes || !m->arena) {
+        free(m->lanes);
+        free(m->arena);
+        free(m);
+        return NULL;
+    }
+    memset(m->arena, 0, words * sizeof(uint32_t));
+
+    m->num = num;
+    m->btbMask = btbSize - 1;
+    m->tagShift = 2 + (unsigned)log2(btbSize);
+    m->tagMask = (1u << cfgs[0].tagSize) - 1;
+    m->tags = (uint32_t *)m->arena;
+
+    uint32_t *word = m->tags + btbSize;
+    uint8_t *byte = (uint8_t *)((uint32_t *)m->arena + words);
+    for (unsigned c = 0; c < num; ++c) {
+        const BP_config *cfg = &cfgs[c];
+        BP_lane *lane = &m->lanes[c];
+        lane->tableSize = 1u << cfg->historySize;
+        lane->histMask = lane->tableSize - 1;
+        lane->histStride = cfg->isGlobalHist ? 0 : 1;
+        lane->tableStride = cfg->isGlobalTable ? 0 : lane->tableSize;
+        lane->shareShift = cfg->Shared == 2 ? 16 : 2;
+        lane->shareMask = cfg->Shared ? lane->histMask : 0;
+        lane->fsmState = cfg->fsmState;
+        lane->targets = word;
+        word += btbSize;
+        lane->histories = word;
+        word += cfg->isGlobalHist ? 1 : btbSize;
+        size_t tables = (size_t)(cfg->isGlobalTable ? 1 : btbSize) * lane->tableSize;
+        lane->fsm = byte;
+        memset(lane->fsm, cfg->fsmState, tables);
+        byte += tables;
+        lane->stats.flush_num = 0;
+        lane->stats.br_num = 0;
+        lane->stats.size = bp_theoretical_size(cfg);
+    }
+    return m;
+}
 
-    // Deallocate all allocated memory
-    if (!bp->isGlobalTable) {
-        for (unsigned i = 0; i < bp->btbSize; ++i) {
-            free(bp->btb[i].fsm);
+// Function to run a batch of branches through all configurations
+void BP_multi_run(BP_multi *m, const BP_branch *br, size_t num) {
+    for (size_t i = 0; i < num; ++i) {
+        // Decode the branch once for all lanes
+        uint32_t pc = br[i].pc;
+        uint32_t targetPc = br[i].targetPc;
+        bool taken = br[i].taken;
+        uint32_t btbIndex = (pc >> 2) & m->btbMask;
+        uint32_t tag = (pc >> m->tagShift) & m->tagMask;
+        uint32_t actual_dst = taken ? targetPc : pc + 4;
+        bool hit = m->tags[btbIndex] == tag;
+
+        if (!hit) {
+            m->tags[btbIndex] = tag;
+            for (unsigned c = 0; c < m->num; ++c) {
+                BP_lane *lane = &m->lanes[c];
+                if (lane->tableStride) {
+                    memset(lane->fsm + btbIndex * lane->tableStride, lane->fsmState, lane->tableSize);
+                }
+            }
+        }
+
+        for (unsigned c = 0; c < m->num; ++c) {
+            BP_lane *lane = &m->lanes[c];
+            uint32_t *historyReg = &lane->histories[btbIndex * lane->histStride];
+            unsigned history = *historyReg;
+            unsigned fsmIndex = history ^ ((pc >> lane->shareShift) & lane->shareMask);
+            uint8_t *counter = &lane->fsm[btbIndex * lane->tableStride + fsmIndex];
+            uint8_t state = *counter;
+
+            // Predict (the counter of a missing entry was already reset, but a miss predicts not taken)
+            uint32_t *target = &lane->targets[btbIndex];
+            uint32_t pred_dst = (hit && state >= 2) ? *target : pc + 4;
+            bool misprediction = pred_dst != actual_dst;
+
+            // Update
+            lane->stats.flush_num += misprediction;
+            *target = (!hit || misprediction) ? targetPc : *target;
+            *counter = taken ? state + (state < 3) : state - (state > 0);
+            *historyReg = ((history << 1) | taken) & lane->histMask;
         }
     }
-    free(bp->btb);
-    if (bp->isGlobalTable) {
-        free(bp->globalFSM);
+    for (unsigned c = 0; c < m->num; ++c) {
+        m->lanes[c].stats.br_num += num;
     }
+}
+
+// Function to retrieve the statistics of one configuration
+void BP_multi_stats(const BP_multi *m, unsigned index, SIM_stats *curStats) {
+    if (!m || index >= m->num || !curStats) return;
+    *curStats = m->lanes[index].stats;
+}
+
+// Function to release a lockstep engine
+void BP_multi_destroy(BP_multi *m) {
+    if (!m) return;
+    free(m->arena);
+    free(m->lanes);
+    free(m);
+}
+
+// Function to retrieve statistics without disturbing the predictor
+void BP_ctx_stats(const BP_ctx *bp, SIM_stats *curStats) {
+    if (!bp || !curStats) return;
+    curStats->flush_num = bp->stats.flush_num;
+    curStats->br_num = bp->stats.br_num;
+    curStats->size = bp->stats.size;
+}
+
+// Function to get the number of bytes the context actually allocated
+size_t BP_ctx_footprint(const BP_ctx *bp) {
+    return bp ? bp->footprint : 0;
+}
+
+// Function to release a Branch Predictor and all of its tables
+void BP_destroy(BP_ctx *bp) {
+    if (bp) bp_profile_free(bp->profile);
     free(bp);
+}
+
+bool BP_predict(uint32_t pc, uint32_t *dst) {
+    return BP_ctx_predict(bp, pc, dst);
+}
+
+void BP_update(uint32_t pc, uint32_t targetPc, bool taken, uint32_t pred_dst) {
+    BP_ctx_update(bp, pc, targetPc, taken, pred_dst);
+}
+
+// Function to retrieve statistics without ending the simulation
+void BP_GetStatsSnapshot(SIM_stats *curStats) {
+    BP_ctx_stats(bp, curStats);
+}
+
+// Function to retrieve statistics and clean up the Branch Predictor
+void BP_GetStats(SIM_stats *curStats) {
+    if (!bp || !curStats) return;
+
+    BP_ctx_stats(bp, curStats);
+    BP_destroy(bp);
     bp = NULL;
 }
@@ -9,6 +9,7 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* A structure to return information about the currect simulator state */
@@ -53,6 +54,246 @@ void BP_update(uint32_t pc, uint32_t targetPc, bool taken, uint32_t pred_dst);
  */
 void BP_GetStats(SIM_stats *curStats);
 
+/*
+ * BP_GetStatsSnapshot: Same as BP_GetStats, but the predictor is left running,
+ * so it may be called at any point (e.g. for interval statistics)
+ */
+void BP_GetStatsSnapshot(SIM_stats *curStats);
+
+/*************************************************************************/
+/* Handle-based API: independent, reentrant predictor instances         */
+/* Each context owns all of its state, so different contexts may be    */
+/* driven concurrently from different threads.                          */
+/*************************************************************************/
+
+/* Opaque predictor context */
+typedef struct BP_ctx BP_ctx;
+
+/* BTB replacement policy of a set-associative BTB */
+typedef enum {
+	BP_BTB_LRU,                   // True LRU
+	BP_BTB_PLRU                   // Tree pseudo-LRU
+} BP_btb_repl;
+
+#define BP_MAX_BTB_SIZE 65536         // Maximal BTB size accepted by BP_create
+#define BP_MAX_BTB_WAYS 16            // Maximal BTB associativity
+
+/* Predictor configuration, as declared in the first line of a trace file */
+typedef struct {
+	unsigned btbSize;
+	unsigned historySize;
+	unsigned tagSize;
+	unsigned fsmState;
+	bool isGlobalHist;
+	bool isGlobalTable;
+	int Shared;
+	unsigned btbWays;             // BTB associativity, 0 or 1 for the direct-mapped BTB
+	BP_btb_repl btbRepl;          // Replacement policy when btbWays > 1
+	bool btbHash;                 // XOR-fold the tag bits into the BTB set index
+} BP_config;
+
+/*
+ * BP_create - allocate and initialize an independent predictor
+ * param[in] cfg - the predictor configuration. Same rules as BP_init, except
+ *                 that btbSize may be any power of 2 up to BP_MAX_BTB_SIZE and
+ *                 the BTB may be set-associative (btbWays a power of 2 up to
+ *                 BP_MAX_BTB_WAYS) and/or hash-indexed. The tag must fit in
+ *                 30 - log2(btbSize / btbWays) bits.
+ *                 A set-associative or hashed BTB keeps a valid bit per entry,
+ *                 so unlike the direct-mapped BTB an empty entry never hits.
+ * return the new context, or NULL on init failure
+ */
+BP_ctx *BP_create(const BP_config *cfg);
+
+/*
+ * BP_ctx_predict - same as BP_predict, on the given context
+ */
+bool BP_ctx_predict(BP_ctx *ctx, uint32_t pc, uint32_t *dst);
+
+/*
+ * BP_ctx_update - same as BP_update, on the given context
+ */
+void BP_ctx_update(BP_ctx *ctx, uint32_t pc, uint32_t targetPc, bool taken, uint32_t pred_dst);
+
+/*
+ * BP_ctx_stats - return the context stats; the context stays usable
+ */
+void BP_ctx_stats(const BP_ctx *ctx, SIM_stats *curStats);
+
+/* A single branch record of a trace */
+typedef struct {
+	uint32_t pc;                  // Branch instruction address
+	uint32_t targetPc;            // Actual target address
+	uint32_t taken;               // Actual decision (1 taken, 0 not taken)
+} BP_branch;
+
+/* The prediction made for a single branch */
+typedef struct {
+	uint32_t dst;                 // Predicted target address
+	uint32_t taken;               // Predicted decision (1 taken, 0 not taken)
+} BP_prediction;
+
+/*
+ * BP_ctx_run - predict and then update each branch of a batch, in order
+ * param[in] br - the branch records
+ * param[in] num - number of records in br
+ * param[out] pred - receives the prediction of each branch, may be NULL when
+ *                   only the aggregate stats (BP_ctx_stats) are wanted
+ */
+void BP_ctx_run(BP_ctx *ctx, const BP_branch *br, size_t num, BP_prediction *pred);
+
+/*
+ * BP_ctx_use_generic - run the context on the generic kernel, which checks the
+ * configuration on every call, instead of the specialized kernel picked by
+ * BP_create (results are identical; meant for benchmarking)
+ */
+void BP_ctx_use_generic(BP_ctx *ctx, bool generic);
+
+/*
+ * BP_ctx_footprint - return the number of bytes actually allocated for the context
+ * (compare with the theoretical SIM_stats.size, which is given in bits)
+ */
+size_t BP_ctx_footprint(const BP_ctx *ctx);
+
+/*
+ * BP_destroy - release a context created by BP_create (NULL is ignored)
+ */
+void BP_destroy(BP_ctx *ctx);
+
+/*************************************************************************/
+/* Predictor engines                                                    */
+/* Direction predictors beyond the two-level scheme, each paired with a */
+/* direct-mapped tagged target buffer; contexts created by              */
+/* BP_create_engine use all the BP_ctx_* functions above.               */
+/*************************************************************************/
+
+typedef enum {
+	BP_ENGINE_GSHARE,             // 2-bit counters indexed by PC xor global history
+	BP_ENGINE_PERCEPTRON,         // Hashed perceptron over geometric global history prefixes
+	BP_ENGINE_TAGE,               // Bimodal base + 4 tagged tables with geometric history lengths
+} BP_engine_kind;
+
+typedef struct {
+	BP_engine_kind kind;
+	unsigned btbBits;             // log2 of the number of target buffer entries (0..16)
+	unsigned tagSize;             // Target buffer tag size (up to 30 - btbBits)
+	unsigned tableBits;           // log2 of the entries of the main direction table (4..22)
+	unsigned historySize;         // Global history length (gshare 1..32, perceptron 8..64, TAGE 8..1023)
+} BP_engine_config;
+
+/*
+ * BP_create_engine - allocate and initialize a predictor engine
+ * SIM_stats.size reports the engine's storage cost in bits, as for BP_init
+ * return the new context, or NULL on init failure
+ */
+BP_ctx *BP_create_engine(const BP_engine_config *cfg);
+
+/*************************************************************************/
+/* Checkpoints                                                          */
+/* A checkpoint holds the full state of a two-level predictor (BTB,     */
+/* replacement state, histories and FSM tables) plus its stats, in a    */
+/* compact, self-describing binary form. It can only be restored into a */
+/* context created with the same configuration. Engines have no         */
+/* checkpoint support.                                                  */
+/*************************************************************************/
+
+/*
+ * BP_ctx_checkpoint_size - return the size of a checkpoint of the context,
+ * 0 when the context cannot be checkpointed
+ */
+size_t BP_ctx_checkpoint_size(const BP_ctx *ctx);
+
+/*
+ * BP_ctx_checkpoint - write a checkpoint of the context into buf
+ * return the number of bytes written, 0 when buf is too small or the context
+ * cannot be checkpointed
+ */
+size_t BP_ctx_checkpoint(const BP_ctx *ctx, void *buf, size_t size);
+
+/*
+ * BP_ctx_restore - load a checkpoint into the context, replacing its state and stats
+ * return 0 on success, <0 when the checkpoint is malformed or was taken with
+ * another configuration (the context is left unchanged)
+ */
+int BP_ctx_restore(BP_ctx *ctx, const void *buf, size_t size);
+
+/*
+ * BP_ctx_reset_stats - zero flush_num and br_num, keeping the predictor state
+ * (e.g. after warming the predictor up)
+ */
+void BP_ctx_reset_stats(BP_ctx *ctx);
+
+/*************************************************************************/
+/* Per-PC profiling                                                     */
+/* Off by default: a context only pays for it once BP_ctx_profile was   */
+/* called, so the predict/update kernels are untouched otherwise.       */
+/*************************************************************************/
+
+/* Profile counters of a single static branch */
+typedef struct {
+	uint32_t pc;                  // Branch instruction address
+	uint32_t executions;          // Times the branch was updated
+	uint32_t dirMisses;           // Flushes with a wrong direction prediction
+	uint32_t targetMisses;        // Flushes of a taken branch predicted taken to a wrong target
+	uint32_t allocations;         // BTB tag misses that allocated an entry for the branch
+} BP_pc_stats;
+
+/*
+ * BP_ctx_profile - start counting per-PC stats on every later update
+ * (works with any context: two-level, set-associative BTB or engine)
+ * param[in] staticBranches - expected number of distinct branches, used to
+ *                            size the hash table up front (0 for a default;
+ *                            the table grows as needed)
+ * return 0 on success, <0 on allocation failure; calling it again clears the counters
+ */
+int BP_ctx_profile(BP_ctx *ctx, size_t staticBranches);
+
+/*
+ * BP_ctx_profile_size - return the number of distinct branches profiled so far
+ */
+size_t BP_ctx_profile_size(const BP_ctx *ctx);
+
+/*
+ * BP_ctx_profile_top - get the num branches with the most flushes
+ * (dirMisses + targetMisses), most flushes first; ties go to the branch with
+ * more executions, then to the lower pc
+ * param[out] out - receives up to num records
+ * return the number of records written
+ */
+size_t BP_ctx_profile_top(const BP_ctx *ctx, BP_pc_stats *out, size_t num);
+
+/*************************************************************************/
+/* Lockstep multi-configuration engine                                  */
+/* Simulates several configurations over one pass of a trace; each      */
+/* branch is decoded once for all of them.                              */
+/*************************************************************************/
+
+/* Opaque lockstep engine */
+typedef struct BP_multi BP_multi;
+
+/*
+ * BP_multi_create - create an engine simulating num configurations in lockstep
+ * all configurations must be valid, use a direct-mapped unhashed BTB and
+ * share the same btbSize and tagSize
+ * return the new engine, or NULL on failure
+ */
+BP_multi *BP_multi_create(const BP_config *cfgs, unsigned num);
+
+/*
+ * BP_multi_run - predict and update a batch of branches in every configuration
+ */
+void BP_multi_run(BP_multi *m, const BP_branch *br, size_t num);
+
+/*
+ * BP_multi_stats - return the stats of configuration index (same order as cfgs)
+ */
+void BP_multi_stats(const BP_multi *m, unsigned index, SIM_stats *curStats);
+
+/*
+ * BP_multi_destroy - release an engine created by BP_multi_create (NULL is ignored)
+ */
+void BP_multi_destroy(BP_multi *m);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,266 @@
+/* 046267 Computer Architecture - HW #1 */
+/* Predictor throughput benchmark suite over synthetic branch streams      */
+/* Usage: ./bp_bench [--branches N] [--seed S] [--reps R] [--workload W]   */
+/*                   [--json] [branches]                                   */
+/* Every workload is run through all 12 history/table/share modes of the   */
+/* BP_* API (BP_predict + BP_update), of the batched BP_ctx_run and of the */
+/* generic kernel; the best of R repetitions is reported. The streams only */
+/* depend on the seed, so runs with equal seeds are comparable.            */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bp_api.h"
+#include "bp_trace.h"
+
+static double now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*************************************************************************/
+/* Synthetic branch streams                                             */
+/*************************************************************************/
+
+/* splitmix64: small, fast and fully determined by the seed */
+static uint64_t next_random(uint64_t *state) {
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+/* Uniform value in [0, bound) */
+static uint32_t random_below(uint64_t *state, uint32_t bound) {
+	return (uint32_t)(((next_random(state) >> 32) * bound) >> 32);
+}
+
+static void set_branch(BP_branch *br, uint32_t pc, uint32_t target, bool taken) {
+	br->pc = pc;
+	br->targetPc = target;
+	br->taken = taken;
+}
+
+/* Nested loops: inner loops of random trip counts inside an outer loop */
+static void gen_loops(BP_branch *br, size_t num, uint64_t seed) {
+	enum { INNER = 8 };
+	uint32_t trips[INNER];
+	for (int l = 0; l < INNER; ++l) {
+		trips[l] = 2 + random_below(&seed, 63);
+	}
+	size_t i = 0;
+	while (i < num) {
+		for (int l = 0; l < INNER && i < num; ++l) {
+			uint32_t pc = 0x400000 + 0x44 * l;
+			for (uint32_t t = 1; t <= trips[l] && i < num; ++t) {
+				set_branch(&br[i++], pc, pc - 0x20, t < trips[l]);
+			}
+		}
+		if (i < num) set_branch(&br[i++], 0x400400, 0x400000, true);
+	}
+}
+
+/* Biased random: 256 branches, each mostly taken or mostly not taken */
+static void gen_biased(BP_branch *br, size_t num, uint64_t seed) {
+	enum { SITES = 256 };
+	uint32_t bias[SITES];
+	for (int s = 0; s < SITES; ++s) {
+		uint32_t skew = 1 + random_below(&seed, 15); // 1..15 in 256
+		bias[s] = (s & 1) ? 256 - skew : skew;
+	}
+	for (size_t i = 0; i < num; ++i) {
+		uint32_t site = random_below(&seed, SITES);
+		uint32_t pc = 0x10000 + (site << 2) + ((site & 0xf) << 16);
+		set_branch(&br[i], pc, pc + 0x40 + (site << 4), random_below(&seed, 256) < bias[site]);
+	}
+}
+
+/* Correlated: a fixed path of 16 branches; each outcome is the xor of the two
+   previous outcomes or follows a short per-branch pattern, with 2% noise */
+static void gen_correlated(BP_branch *br, size_t num, uint64_t seed) {
+	enum { PATH = 16 };
+	uint32_t pattern[PATH];
+	for (int s = 0; s < PATH; ++s) {
+		pattern[s] = (uint32_t)next_random(&seed);
+	}
+	bool prev1 = false, prev2 = true;
+	uint32_t iteration = 0;
+	for (size_t i = 0; i < num; ++i) {
+		uint32_t site = i % PATH;
+		if (site == 0) iteration++;
+		bool taken = (site & 1) ? (prev1 ^ prev2) : ((pattern[site] >> (iteration % (4 + site))) & 1);
+		if (random_below(&seed, 100) < 2) taken = !taken;
+		uint32_t pc = 0x800000 + 0x24 * site;
+		set_branch(&br[i], pc, pc + 0x100, taken);
+		prev2 = prev1;
+		prev1 = taken;
+	}
+}
+
+/* BTB thrashing: 65536 static branches visited at random, mostly taken */
+static void gen_thrash(BP_branch *br, size_t num, uint64_t seed) {
+	for (size_t i = 0; i < num; ++i) {
+		uint32_t site = random_below(&seed, 65536);
+		uint32_t pc = 0x1000000 + (site << 2);
+		set_branch(&br[i], pc, pc + 0x800, random_below(&seed, 8) != 0);
+	}
+}
+
+typedef struct {
+	const char *name;
+	void (*generate)(BP_branch *br, size_t num, uint64_t seed);
+} workload;
+
+static const workload workloads[] = {
+	{ "loops", gen_loops },
+	{ "biased", gen_biased },
+	{ "correlated", gen_correlated },
+	{ "thrash", gen_thrash },
+};
+
+/*************************************************************************/
+/* Measurement                                                          */
+/*************************************************************************/
+
+typedef enum { API_BP, API_BATCH, API_GENERIC } bench_api;
+
+static const char *api_names[] = { "BP_predict/BP_update", "BP_ctx_run", "generic" };
+
+/* Run the whole stream once through a fresh predictor, return the seconds spent */
+static double run_once(const BP_config *cfg, const BP_branch *br, size_t num, bench_api api, unsigned *flush_num) {
+	SIM_stats stats;
+	double start, elapsed;
+	if (api == API_BP) {
+		if (BP_init(cfg->btbSize, cfg->historySize, cfg->tagSize, cfg->fsmState,
+				cfg->isGlobalHist, cfg->isGlobalTable, cfg->Shared) < 0) {
+			fprintf(stderr, "Predictor init failed\n");
+			exit(8);
+		}
+		start = now_sec();
+		for (size_t i = 0; i < num; ++i) {
+			uint32_t dst = 0;
+			BP_predict(br[i].pc, &dst);
+			BP_update(br[i].pc, br[i].targetPc, br[i].taken, dst);
+		}
+		elapsed = now_sec() - start;
+		BP_GetStats(&stats);
+	} else {
+		BP_ctx *ctx = BP_create(cfg);
+		if (!ctx) {
+			fprintf(stderr, "Predictor init failed\n");
+			exit(8);
+		}
+		start = now_sec();
+		if (api == API_BATCH) {
+			BP_ctx_run(ctx, br, num, NULL);
+		} else {
+			BP_ctx_use_generic(ctx, true);
+			for (size_t i = 0; i < num; ++i) {
+				uint32_t dst = 0;
+				BP_ctx_predict(ctx, br[i].pc, &dst);
+				BP_ctx_update(ctx, br[i].pc, br[i].targetPc, br[i].taken, dst);
+			}
+		}
+		elapsed = now_sec() - start;
+		BP_ctx_stats(ctx, &stats);
+		BP_destroy(ctx);
+	}
+	*flush_num = stats.flush_num;
+	return elapsed;
+}
+
+int main(int argc, char **argv) {
+	size_t num = 10000000;
+	uint64_t seed = 12345;
+	unsigned reps = 3;
+	bool json = false;
+	const char *only = NULL;
+	for (int a = 1; a < argc; ++a) {
+		if (strcmp(argv[a], "--branches") == 0 && a + 1 < argc) {
+			num = strtoul(argv[++a], NULL, 0);
+		} else if (strcmp(argv[a], "--seed") == 0 && a + 1 < argc) {
+			seed = strtoull(argv[++a], NULL, 0);
+		} else if (strcmp(argv[a], "--reps") == 0 && a + 1 < argc) {
+			reps = strtoul(argv[++a], NULL, 0);
+		} else if (strcmp(argv[a], "--workload") == 0 && a + 1 < argc) {
+			only = argv[++a];
+		} else if (strcmp(argv[a], "--json") == 0) {
+			json = true;
+		} else if (argv[a][0] != '-') {
+			num = strtoul(argv[a], NULL, 0);
+		} else {
+			fprintf(stderr, "Usage: %s [--branches N] [--seed S] [--reps R] [--workload W] [--json] [branches]\n", argv[0]);
+			exit(1);
+		}
+	}
+	if (num == 0 || reps == 0) {
+		fprintf(stderr, "Error in arguments: branches and reps must be positive\n");
+		exit(1);
+	}
+
+	BP_branch *br = (BP_branch *)malloc(num * sizeof(BP_branch));
+	if (!br) {
+		fprintf(stderr, "out of memory\n");
+		exit(10);
+	}
+
+	static const char *hist[] = { "local_history", "global_history" };
+	static const char *table[] = { "local_tables", "global_tables" };
+	static const char *share[] = { "not_using_share", "using_share_lsb", "using_share_mid" };
+
+	if (json) {
+		printf("{\n  \"branches\": %zu,\n  \"seed\": %llu,\n  \"reps\": %u,\n  \"results\": [",
+				num, (unsigned long long)seed, reps);
+	} else {
+		printf("%-11s %-52s %-21s %12s %9s %10s\n", "workload", "config", "api", "br/s", "ns/br", "flush_num");
+	}
+	bool first = true, mismatch = false;
+	for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); ++w) {
+		if (only && strcmp(only, workloads[w].name) != 0) continue;
+		workloads[w].generate(br, num, seed + w);
+
+		for (int gh = 0; gh < 2; ++gh) {
+			for (int gt = 0; gt < 2; ++gt) {
+				for (int sh = 0; sh < 3; ++sh) {
+					BP_config cfg = { 32, 8, 20, 1, gh, gt, sh };
+					char name[64];
+					snprintf(name, sizeof(name), "32 8 20 1 %s %s %s", hist[gh], table[gt], share[sh]);
+					unsigned flushes[3];
+					for (int api = API_BP; api <= API_GENERIC; ++api) {
+						double best = 0;
+						for (unsigned r = 0; r < reps; ++r) {
+							double t = run_once(&cfg, br, num, (bench_api)api, &flushes[api]);
+							if (r == 0 || t < best) best = t;
+						}
+						double ns = 1e9 * best / num;
+						if (json) {
+							printf("%s\n    { \"workload\": \"%s\", \"config\": \"%s\", \"api\": \"%s\", "
+									"\"branches_per_sec\": %.0f, \"ns_per_branch\": %.3f, \"flush_num\": %u }",
+									first ? "" : ",", workloads[w].name, name, api_names[api],
+									num / best, ns, flushes[api]);
+						} else {
+							printf("%-11s %-52s %-21s %12.0f %9.3f %10u\n", workloads[w].name, name,
+									api_names[api], num / best, ns, flushes[api]);
+						}
+						first = false;
+					}
+					if (flushes[API_BATCH] != flushes[API_BP] || flushes[API_GENERIC] != flushes[API_BP]) {
+						fprintf(stderr, "MISMATCH: %s %s\n", workloads[w].name, name);
+						mismatch = true;
+					}
+				}
+			}
+		}
+	}
+	if (json) {
+		printf("\n  ]\n}\n");
+	}
+
+	free(br);
+	return mismatch ? 1 : 0;
+}
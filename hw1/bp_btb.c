@@ -0,0 +1,257 @@
+/* 046267 Computer Architecture - HW #1 */
+/* Two-level predictor with a set-associative and/or hashed BTB */
+
+#include "bp_api.h"
+#include "bp_internal.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The BTB is split into btbSize / btbWays sets. The entries of a set are
+// adjacent in every per-entry array, so looking a branch up compares the
+// btbWays contiguous tags of its set at once (SSE2 when available) and
+// costs about the same for 1 and 16 ways. A stored tag carries a valid bit,
+// so an empty (zero) entry never hits. History registers and FSM tables
+// belong to BTB entries and follow the same rules as the direct-mapped
+// predictor: allocating an entry resets its local FSM table, and the entry's
+// history register keeps shifting.
+
+// Function to get the ways of a set whose tag equals tag, as a bit mask
+static inline unsigned btb_match(const uint32_t *tags, uint32_t tag, unsigned ways) {
+    unsigned mask = 0;
+#if defined(__SSE2__)
+    if (ways >= 4) {
+        __m128i key = _mm_set1_epi32((int)tag);
+        for (unsigned w = 0; w < ways; w += 4) {
+            __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(tags + w)), key);
+            mask |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(eq)) << w;
+        }
+        return mask;
+    }
+#endif
+    for (unsigned w = 0; w < ways; ++w) {
+        mask |= (unsigned)(tags[w] == tag) << w;
+    }
+    return mask;
+}
+
+// LRU: the ages of a set are a permutation of 0..ways-1, 0 being the most
+// recently used. Empty entries are never touched, so they always stay older
+// than the valid ones and get filled first.
+static inline void lru_touch(uint8_t *ages, unsigned way, unsigned ways) {
+    uint8_t age = ages[way];
+    for (unsigned w = 0; w < ways; ++w) {
+        ages[w] += ages[w] < age;
+    }
+    ages[way] = 0;
+}
+
+static inline unsigned lru_victim(const uint8_t *ages, unsigned ways) {
+    unsigned victim = 0;
+    for (unsigned w = 0; w < ways; ++w) {
+        victim = ages[w] == ways - 1 ? w : victim;
+    }
+    return victim;
+}
+
+// Tree PLRU: bit n of a set's bits is internal node n of a heap-ordered
+// binary tree (root 1); a set bit sends the victim search to the right child.
+static inline void plru_touch(uint16_t *bits, unsigned way, unsigned ways) {
+    unsigned node = 1;
+    for (unsigned half = ways >> 1; half > 0; half >>= 1) {
+        unsigned right = (way & half) != 0;
+        *bits = right ? (uint16_t)(*bits & ~(1u << node)) : (uint16_t)(*bits | (1u << node));
+        node = 2 * node + right;
+    }
+}
+
+static inline unsigned plru_victim(uint16_t bits, const uint32_t *tags, unsigned ways) {
+    unsigned empty = btb_match(tags, 0, ways);
+    if (empty) return __builtin_ctz(empty);
+    unsigned node = 1, way = 0;
+    for (unsigned half = ways >> 1; half > 0; half >>= 1) {
+        unsigned right = (bits >> node) & 1;
+        way = 2 * way + right;
+        node = 2 * node + right;
+    }
+    return way;
+}
+
+// Function to find the set of a branch, returns its first entry; *tag gets the stored tag
+static inline uint32_t btb_set(const BP *bp, uint32_t pc, uint32_t *tag) {
+    uint32_t upper = pc >> bp->tagShift;
+    *tag = (upper & bp->tagMask) | BTB_VALID;
+    return (((pc >> 2) ^ (upper & bp->hashMask)) & bp->btbMask) * bp->btbWays;
+}
+
+// Function to predict with the entry found by the lookup (hit is a bit mask of ways)
+static inline bool assoc_predict_at(const BP *bp, uint32_t pc, uint32_t base, unsigned hit, uint32_t *dst) {
+    if (!hit) {
+        *dst = pc + 4;
+        return false;
+    }
+    uint32_t entry = base + __builtin_ctz(hit);
+    unsigned history = bp->histories[entry * bp->histStride];
+    unsigned fsmIndex = history ^ ((pc >> bp->shareShift) & bp->shareMask);
+    bool taken = bp->fsm[entry * bp->tableStride + fsmIndex] >= 2;
+    *dst = taken ? bp->targets[entry] : pc + 4;
+    return taken;
+}
+
+// Function to update with the entry found by the lookup, allocating on a miss
+static inline void assoc_update_at(BP *bp, uint32_t pc, uint32_t targetPc, bool taken, uint32_t pred_dst,
+                                   uint32_t base, uint32_t tag, unsigned hit, unsigned ways, bool plru) {
+    uint32_t set = base / ways;
+    unsigned way;
+    if (hit) {
+        way = __builtin_ctz(hit);
+    } else if (ways == 1) {
+        way = 0;
+    } else {
+        way = plru ? plru_victim(bp->plru[set], bp->tags + base, ways) : lru_victim(bp->ages + base, ways);
+    }
+    uint32_t entry = base + way;
+    if (ways > 1) {
+        if (plru) {
+            plru_touch(&bp->plru[set], way, ways);
+        } else {
+            lru_touch(bp->ages + base, way, ways);
+        }
+    }
+
+    uint32_t *historyReg = &bp->histories[entry * bp->histStride];
+    unsigned history = *historyReg;
+    unsigned fsmIndex = history ^ ((pc >> bp->shareShift) & bp->shareMask);
+    uint8_t *fsm = bp->fsm + entry * bp->tableStride;
+
+    if (!hit) {
+        bp->tags[entry] = tag;
+        bp->targets[entry] = targetPc;
+        if (bp->tableStride) {
+            memset(fsm, bp->fsmState, bp->tableSize);
+        }
+    }
+    if (pred_dst != (taken ? targetPc : pc + 4)) {
+        bp->stats.flush_num++;
+        bp->targets[entry] = targetPc;
+    }
+
+    uint8_t state = fsm[fsmIndex];
+    fsm[fsmIndex] = taken ? state + (state < 3) : state - (state > 0);
+    *historyReg = ((history << 1) | taken) & bp->histMask;
+    bp->stats.br_num++;
+}
+
+// Instantiate the kernels of one (associativity, replacement policy) combination
+#define BP_ASSOC_VARIANT(WAYS, PLRU) \
+static bool assoc_predict_##WAYS##_##PLRU(BP *bp, uint32_t pc, uint32_t *dst) { \
+    uint32_t tag; \
+    uint32_t base = btb_set(bp, pc, &tag); \
+    return assoc_predict_at(bp, pc, base, btb_match(bp->tags + base, tag, WAYS), dst); \
+} \
+static void assoc_update_##WAYS##_##PLRU(BP *bp, uint32_t pc, uint32_t targetPc, bool taken, uint32_t pred_dst) { \
+    uint32_t tag; \
+    uint32_t base = btb_set(bp, pc, &tag); \
+    unsigned hit = btb_match(bp->tags + base, tag, WAYS); \
+    assoc_update_at(bp, pc, targetPc, taken, pred_dst, base, tag, hit, WAYS, PLRU); \
+} \
+static void assoc_run_##WAYS##_##PLRU(BP *bp, const BP_branch *br, size_t num, BP_prediction *pred) { \
+    for (size_t i = 0; i < num; ++i) { \
+        uint32_t tag, dst; \
+        uint32_t base = btb_set(bp, br[i].pc, &tag); \
+        unsigned hit = btb_match(bp->tags + base, tag, WAYS); \
+        bool taken = assoc_predict_at(bp, br[i].pc, base, hit, &dst); \
+        if (pred) { \
+            pred[i].dst = dst; \
+            pred[i].taken = taken; \
+        } \
+        assoc_update_at(bp, br[i].pc, br[i].targetPc, br[i].taken, dst, base, tag, hit, WAYS, PLRU); \
+    } \
+} \
+static bool assoc_probe_##WAYS##_##PLRU(const BP *bp, uint32_t pc) { \
+    uint32_t tag; \
+    uint32_t base = btb_set(bp, pc, &tag); \
+    return btb_match(bp->tags + base, tag, WAYS) != 0; \
+}
+
+BP_ASSOC_VARIANT(1, 0)
+BP_ASSOC_VARIANT(2, 0) BP_ASSOC_VARIANT(4, 0) BP_ASSOC_VARIANT(8, 0) BP_ASSOC_VARIANT(16, 0)
+BP_ASSOC_VARIANT(2, 1) BP_ASSOC_VARIANT(4, 1) BP_ASSOC_VARIANT(8, 1) BP_ASSOC_VARIANT(16, 1)
+
+#define BP_ASSOC_ENTRY(WAYS, PLRU) \
+    { assoc_predict_##WAYS##_##PLRU, assoc_update_##WAYS##_##PLRU, assoc_run_##WAYS##_##PLRU, \
+      assoc_probe_##WAYS##_##PLRU }
+
+// Dispatch table, indexed [log2(btbWays)][btbRepl]
+static const BP_kernel bp_assoc_kernels[5][2] = {
+    { BP_ASSOC_ENTRY(1, 0),  BP_ASSOC_ENTRY(1, 0) },
+    { BP_ASSOC_ENTRY(2, 0),  BP_ASSOC_ENTRY(2, 1) },
+    { BP_ASSOC_ENTRY(4, 0),  BP_ASSOC_ENTRY(4, 1) },
+    { BP_ASSOC_ENTRY(8, 0),  BP_ASSOC_ENTRY(8, 1) },
+    { BP_ASSOC_ENTRY(16, 0), BP_ASSOC_ENTRY(16, 1) },
+};
+
+BP *bp_create_assoc(const BP_config *cfg) {
+    unsigned btbSize = cfg->btbSize;
+    unsigned ways = cfg->btbWays ? cfg->btbWays : 1;
+    unsigned numSets = btbSize / ways;
+    int log_num_sets = log2(numSets);
+    bool plru = ways > 1 && cfg->btbRepl == BP_BTB_PLRU;
+
+    // Lay out the arena: 32-bit arrays, then the PLRU bits, then byte-wide counters and ages
+    unsigned tableSize = 1u << cfg->historySize;
+    unsigned num_of_fsms = cfg->isGlobalTable ? 1 : btbSize;
+    unsigned num_of_histories = cfg->isGlobalHist ? 1 : btbSize;
+    size_t words = 2 * (size_t)btbSize + num_of_histories;
+    size_t halves = plru ? numSets : 0;
+    size_t fsmBytes = (size_t)num_of_fsms * tableSize;
+    size_t ageBytes = (ways > 1 && !plru) ? btbSize : 0;
+    size_t bytes = sizeof(BP) + words * sizeof(uint32_t) + halves * sizeof(uint16_t) + fsmBytes + ageBytes;
+
+    BP *bp = (BP *)malloc(bytes);
+    if (!bp) return NULL;
+    bp->tags = (uint32_t *)(bp + 1);
+    bp->targets = bp->tags + btbSize;
+    bp->histories = bp->targets + btbSize;
+    bp->plru = plru ? (uint16_t *)(bp->histories + num_of_histories) : NULL;
+    bp->fsm = (uint8_t *)((uint16_t *)(bp->histories + num_of_histories) + halves);
+    bp->ages = ageBytes ? bp->fsm + fsmBytes : NULL;
+
+    memset(bp->tags, 0, words * sizeof(uint32_t) + halves * sizeof(uint16_t));
+    memset(bp->fsm, cfg->fsmState, fsmBytes);
+    for (size_t e = 0; e < ageBytes; ++e) {
+        bp->ages[e] = e % ways;
+    }
+
+    bp->btbSize = btbSize;
+    bp->historySize = cfg->historySize;
+    bp->tagSize = cfg->tagSize;
+    bp->fsmState = cfg->fsmState;
+    bp->isGlobalHist = cfg->isGlobalHist;
+    bp->isGlobalTable = cfg->isGlobalTable;
+    bp->Shared = cfg->Shared;
+    bp->tableSize = tableSize;
+    bp->btbMask = numSets - 1;
+    bp->tagShift = 2 + log_num_sets;
+    bp->tagMask = (1u << cfg->tagSize) - 1;
+    bp->histMask = tableSize - 1;
+    bp->btbWays = ways;
+    bp->btbHash = cfg->btbHash;
+    bp->hashMask = cfg->btbHash ? numSets - 1 : 0;
+    bp->histStride = cfg->isGlobalHist ? 0 : 1;
+    bp->tableStride = cfg->isGlobalTable ? 0 : tableSize;
+    bp->shareShift = cfg->Shared == 2 ? 16 : 2;
+    bp->shareMask = cfg->Shared ? bp->histMask : 0;
+    bp->kernel = bp_assoc_kernels[(int)log2(ways)][plru];
+    bp->engine = NULL;
+    bp->profile = NULL;
+    bp->footprint = bytes;
+    bp->stats.flush_num = 0;
+    bp->stats.br_num = 0;
+    bp->stats.size = bp_theoretical_size(cfg);
+    return bp;
+}
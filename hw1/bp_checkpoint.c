@@ -0,0 +1,193 @@
+/* 046267 Computer Architecture - HW #1 */
+/* Checkpoint and restore of a two-level predictor's state */
+
+#include "bp_api.h"
+#include "bp_internal.h"
+#include <string.h>
+
+// Checkpoint layout (native byte order):
+//   bp_ckpt_header
+//   BTB tags and targets, 4 bytes per entry
+//   history registers, 1 byte each (historySize is at most 8)
+//   FSM counters, 2 bits each, 4 to a byte
+//   LRU ages (1 byte per entry) or PLRU bits (2 bytes per set), when the BTB has them
+// The header repeats the configuration, so a checkpoint is only restored
+// into a predictor with the same layout.
+
+#define BP_CKPT_MAGIC "BPCK"
+#define BP_CKPT_VERSION 1
+
+// Configuration flags of a checkpoint
+#define CKPT_GLOBAL_HIST  1u
+#define CKPT_GLOBAL_TABLE 2u
+#define CKPT_HASH         4u
+#define CKPT_PLRU         8u
+
+typedef struct {
+    char magic[4];            // BP_CKPT_MAGIC
+    uint32_t version;         // BP_CKPT_VERSION
+    uint32_t btbSize;
+    uint32_t historySize;
+    uint32_t tagSize;
+    uint32_t fsmState;
+    uint32_t Shared;
+    uint32_t btbWays;
+    uint32_t flags;           // CKPT_* flags
+    uint32_t flush_num;       // Stats at the checkpoint
+    uint32_t br_num;
+} bp_ckpt_header;
+
+static void ckpt_fill_header(const BP *bp, bp_ckpt_header *h) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, BP_CKPT_MAGIC, 4);
+    h->version = BP_CKPT_VERSION;
+    h->btbSize = bp->btbSize;
+    h->historySize = bp->historySize;
+    h->tagSize = bp->tagSize;
+    h->fsmState = bp->fsmState;
+    h->Shared = bp->Shared;
+    h->btbWays = bp->btbWays;
+    h->flags = (bp->isGlobalHist ? CKPT_GLOBAL_HIST : 0) | (bp->isGlobalTable ? CKPT_GLOBAL_TABLE : 0) |
+               (bp->btbHash ? CKPT_HASH : 0) | (bp->plru ? CKPT_PLRU : 0);
+    h->flush_num = bp->stats.flush_num;
+    h->br_num = bp->stats.br_num;
+}
+
+static size_t ckpt_histories(const BP *bp) {
+    return bp->isGlobalHist ? 1 : bp->btbSize;
+}
+
+static size_t ckpt_counters(const BP *bp) {
+    return (size_t)(bp->isGlobalTable ? 1 : bp->btbSize) * bp->tableSize;
+}
+
+// Check the BTB part of a checkpoint body before anything is restored: every
+// tag fits the tag size (with the valid bit, or 0 when empty, for the BTB of
+// bp_btb.c), the LRU ages of every set are a permutation of 0..ways-1, and
+// the PLRU bits only use the tree's nodes 1..ways-1
+static bool ckpt_valid(const BP *bp, const uint8_t *in) {
+    bool assoc = bp->btbWays > 1 || bp->btbHash;
+    for (size_t e = 0; e < bp->btbSize; ++e) {
+        uint32_t tag;
+        memcpy(&tag, in + e * sizeof(uint32_t), sizeof(tag));
+        bool ok = assoc ? tag == 0 || (tag & ~bp->tagMask) == BTB_VALID : (tag & ~bp->tagMask) == 0;
+        if (!ok) return false;
+    }
+    in += 2 * (size_t)bp->btbSize * sizeof(uint32_t) + ckpt_histories(bp) + (ckpt_counters(bp) + 3) / 4;
+
+    unsigned ways = bp->btbWays, sets = bp->btbSize / bp->btbWays;
+    if (bp->ages) {
+        for (unsigned s = 0; s < sets; ++s, in += ways) {
+            uint32_t seen = 0;
+            for (unsigned w = 0; w < ways; ++w) {
+                if (in[w] >= ways) return false;
+                seen |= 1u << in[w];
+            }
+            if (seen != (uint32_t)((1ull << ways) - 1)) return false;
+        }
+    }
+    if (bp->plru) {
+        uint16_t nodes = (uint16_t)(((1u << ways) - 1) & ~1u);
+        for (unsigned s = 0; s < sets; ++s) {
+            uint16_t bits;
+            memcpy(&bits, in + s * sizeof(uint16_t), sizeof(bits));
+            if (bits & ~nodes) return false;
+        }
+    }
+    return true;
+}
+
+// Function to get the size of a checkpoint of the context
+size_t BP_ctx_checkpoint_size(const BP_ctx *bp) {
+    if (!bp || bp->engine) return 0;
+    size_t size = sizeof(bp_ckpt_header) + 2 * (size_t)bp->btbSize * sizeof(uint32_t);
+    size += ckpt_histories(bp) + (ckpt_counters(bp) + 3) / 4;
+    if (bp->ages) size += bp->btbSize;
+    if (bp->plru) size += (bp->btbSize / bp->btbWays) * sizeof(uint16_t);
+    return size;
+}
+
+// Function to write a checkpoint of the context
+size_t BP_ctx_checkpoint(const BP_ctx *bp, void *buf, size_t size) {
+    size_t total = BP_ctx_checkpoint_size(bp);
+    if (total == 0 || !buf || size < total) return 0;
+    uint8_t *out = (uint8_t *)buf;
+
+    bp_ckpt_header header;
+    ckpt_fill_header(bp, &header);
+    memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+
+    memcpy(out, bp->tags, bp->btbSize * sizeof(uint32_t));
+    out += bp->btbSize * sizeof(uint32_t);
+    memcpy(out, bp->targets, bp->btbSize * sizeof(uint32_t));
+    out += bp->btbSize * sizeof(uint32_t);
+    for (size_t i = 0; i < ckpt_histories(bp); ++i) {
+        *out++ = (uint8_t)bp->histories[i];
+    }
+
+    size_t counters = ckpt_counters(bp);
+    memset(out, 0, (counters + 3) / 4);
+    for (size_t i = 0; i < counters; ++i) {
+        out[i / 4] |= (bp->fsm[i] & 3) << (2 * (i % 4));
+    }
+    out += (counters + 3) / 4;
+
+    if (bp->ages) {
+        memcpy(out, bp->ages, bp->btbSize);
+        out += bp->btbSize;
+    }
+    if (bp->plru) {
+        memcpy(out, bp->plru, (bp->btbSize / bp->btbWays) * sizeof(uint16_t));
+    }
+    return total;
+}
+
+// Function to load a checkpoint into the context
+int BP_ctx_restore(BP_ctx *bp, const void *buf, size_t size) {
+    size_t total = BP_ctx_checkpoint_size(bp);
+    if (total == 0 || !buf || size != total) return -1;
+    const uint8_t *in = (const uint8_t *)buf;
+
+    // The whole header, stats aside, must match this context's configuration
+    bp_ckpt_header header, expected;
+    memcpy(&header, in, sizeof(header));
+    ckpt_fill_header(bp, &expected);
+    expected.flush_num = header.flush_num;
+    expected.br_num = header.br_num;
+    if (memcmp(&header, &expected, sizeof(header)) != 0) return -1;
+    in += sizeof(header);
+    if (!ckpt_valid(bp, in)) return -1;
+
+    memcpy(bp->tags, in, bp->btbSize * sizeof(uint32_t));
+    in += bp->btbSize * sizeof(uint32_t);
+    memcpy(bp->targets, in, bp->btbSize * sizeof(uint32_t));
+    in += bp->btbSize * sizeof(uint32_t);
+    for (size_t i = 0; i < ckpt_histories(bp); ++i) {
+        bp->histories[i] = *in++ & bp->histMask;
+    }
+
+    size_t counters = ckpt_counters(bp);
+    for (size_t i = 0; i < counters; ++i) {
+        bp->fsm[i] = (in[i / 4] >> (2 * (i % 4))) & 3;
+    }
+    in += (counters + 3) / 4;
+
+    if (bp->ages) {
+        memcpy(bp->ages, in, bp->btbSize);
+        in += bp->btbSize;
+    }
+    if (bp->plru) {
+        memcpy(bp->plru, in, (bp->btbSize / bp->btbWays) * sizeof(uint16_t));
+    }
+    bp->stats.flush_num = header.flush_num;
+    bp->stats.br_num = header.br_num;
+    return 0;
+}
+
+// Function to zero the stats, keeping the predictor state
+void BP_ctx_reset_stats(BP_ctx *bp) {
+    if (!bp) return;
+    bp->stats.flush_num = 0;
+    bp->stats.br_num = 0;
+}
@@ -0,0 +1,497 @@
+/* 046267 Computer Architecture - HW #1 */
+/* Predictor engines: gshare, hashed perceptron and TAGE */
+
+#include "bp_api.h"
+#include "bp_internal.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Every engine pairs a direction predictor with a direct-mapped, tagged
+// target buffer that behaves like the two-level predictor's BTB: a tag miss
+// predicts not taken and allocates the entry, a misprediction corrects the
+// target. All state of an engine lives in one allocation that starts with the
+// BP_ctx, followed by the engine structure and its tables.
+
+#define BP_TARGET_SIZE 30         // Target bits counted in SIM_stats.size, as in bp.c
+
+// Target buffer of an engine
+typedef struct {
+    uint32_t *tags;           // BTB tags
+    uint32_t *targets;        // BTB target addresses
+    uint32_t mask;            // BTB index mask
+    unsigned tagShift;        // PC shift to the tag bits
+    uint32_t tagMask;         // Tag mask
+} bp_btb;
+
+static inline bool btb_lookup(const bp_btb *btb, uint32_t pc, uint32_t *target) {
+    uint32_t index = (pc >> 2) & btb->mask;
+    *target = btb->targets[index];
+    return btb->tags[index] == ((pc >> btb->tagShift) & btb->tagMask);
+}
+
+static inline void btb_update(bp_btb *btb, uint32_t pc, uint32_t targetPc, bool misprediction) {
+    uint32_t index = (pc >> 2) & btb->mask;
+    uint32_t tag = (pc >> btb->tagShift) & btb->tagMask;
+    if (btb->tags[index] != tag || misprediction) {
+        btb->tags[index] = tag;
+        btb->targets[index] = targetPc;
+    }
+}
+
+// Saturating counter helpers
+static inline uint8_t counter2_update(uint8_t state, bool taken) {
+    return taken ? state + (state < 3) : state - (state > 0);
+}
+
+static inline int sat_update(int value, bool up, int min, int max) {
+    if (up) return value < max ? value + 1 : value;
+    return value > min ? value - 1 : value;
+}
+
+// Arena allocation: bump allocator over the single allocation of a context
+typedef struct {
+    char *next;
+} bp_arena;
+
+static void *arena_take(bp_arena *arena, size_t bytes) {
+    void *p = arena->next;
+    arena->next += (bytes + 7) & ~(size_t)7;
+    return p;
+}
+
+static size_t arena_size(size_t bytes) {
+    return (bytes + 7) & ~(size_t)7;
+}
+
+/*************************************************************************/
+/* gshare: 2-bit counters indexed by PC xor global history               */
+/*************************************************************************/
+
+typedef struct {
+    bp_btb btb;
+    uint8_t *counters;        // 2-bit counters, one byte each
+    uint32_t mask;            // Table index mask
+    uint32_t ghist;           // Global history register
+    uint32_t histMask;        // Global history mask
+} gshare_state;
+
+typedef struct {
+    uint32_t index;           // Counter used for the prediction
+    bool taken;               // Predicted direction
+} gshare_lookup_t;
+
+static inline gshare_lookup_t gshare_lookup(gshare_state *st, uint32_t pc) {
+    gshare_lookup_t l;
+    l.index = ((pc >> 2) ^ st->ghist) & st->mask;
+    l.taken = st->counters[l.index] >= 2;
+    return l;
+}
+
+static inline void gshare_train(gshare_state *st, const gshare_lookup_t *l, bool taken) {
+    st->counters[l->index] = counter2_update(st->counters[l->index], taken);
+    st->ghist = ((st->ghist << 1) | taken) & st->histMask;
+}
+
+/*************************************************************************/
+/* Hashed perceptron: signed weights from tables indexed by PC hashed    */
+/* with global history prefixes of geometric lengths                     */
+/*************************************************************************/
+
+#define PERCEPTRON_TABLES 8
+#define PERCEPTRON_THETA 29       // Training threshold, 1.93 * tables + 14
+
+typedef struct {
+    bp_btb btb;
+    int8_t *weights;          // PERCEPTRON_TABLES tables of weights, one after another
+    uint32_t mask;            // Table index mask
+    unsigned tableBits;       // log2 of the entries of a table
+    uint64_t ghist;           // Global history register
+    uint64_t histMask;        // Global history mask
+    uint64_t segMask[PERCEPTRON_TABLES]; // History prefix used by each table
+} perceptron_state;
+
+typedef struct {
+    uint32_t index[PERCEPTRON_TABLES]; // Weight used from each table (absolute)
+    int sum;                  // Perceptron output
+    bool taken;               // Predicted direction
+} perceptron_lookup_t;
+
+// Hash a history prefix into bits wide index bits (one multiply, no loop)
+static inline uint32_t hash_history(uint64_t hist, unsigned bits) {
+    return (uint32_t)((hist * 0x9e3779b97f4a7c15ull) >> (64 - bits));
+}
+
+static inline perceptron_lookup_t perceptron_lookup(perceptron_state *st, uint32_t pc) {
+    perceptron_lookup_t l;
+    uint32_t pcHash = (pc >> 2) ^ (pc >> (2 + st->tableBits));
+    l.sum = 0;
+    for (unsigned t = 0; t < PERCEPTRON_TABLES; ++t) {
+        uint32_t hist = hash_history((st->ghist & st->segMask[t]) + t, st->tableBits);
+        uint32_t index = (pcHash ^ hist) & st->mask;
+        l.index[t] = (t << st->tableBits) | index;
+        l.sum += st->weights[l.index[t]];
+    }
+    l.taken = l.sum >= 0;
+    return l;
+}
+
+static inline void perceptron_train(perceptron_state *st, const perceptron_lookup_t *l, bool taken) {
+    if (l->taken != taken || (l->sum < PERCEPTRON_THETA && l->sum > -PERCEPTRON_THETA)) {
+        for (unsigned t = 0; t < PERCEPTRON_TABLES; ++t) {
+            int8_t *w = &st->weights[l->index[t]];
+            *w = (int8_t)sat_update(*w, taken, -128, 127);
+        }
+    }
+    st->ghist = ((st->ghist << 1) | taken) & st->histMask;
+}
+
+/*************************************************************************/
+/* TAGE: bimodal base predictor and tagged tables indexed with           */
+/* geometrically increasing global history lengths                       */
+/*************************************************************************/
+
+#define TAGE_TABLES 4
+#define TAGE_MIN_HIST 4
+#define TAGE_HIST_BUFFER 1024     // Circular global history buffer (bits, one per byte)
+#define TAGE_U_RESET_PERIOD (1u << 18) // Branches between useful counter decays
+
+// Tagged table entry, 4 bytes so that a lookup touches a single cache line per table
+typedef struct {
+    int8_t ctr;               // 3-bit signed prediction counter (-4..3)
+    uint8_t u;                // 2-bit useful counter
+    uint16_t tag;             // Partial tag
+} tage_entry;
+
+// History folded incrementally into a compressed register of clen bits
+typedef struct {
+    uint32_t comp;
+    unsigned clen;            // Compressed length
+    unsigned olen;            // Original (history) length
+    unsigned outpoint;        // olen % clen
+} tage_folded;
+
+typedef struct {
+    bp_btb btb;
+    uint8_t *bimodal;         // 2-bit base counters, one byte each
+    uint32_t bimodalMask;
+    tage_entry *tables[TAGE_TABLES];
+    uint32_t tableMask;       // Tagged table index mask
+    unsigned tableBits;       // log2 of the entries of a tagged table
+    uint16_t tagMask[TAGE_TABLES];
+    tage_folded foldIndex[TAGE_TABLES];
+    tage_folded foldTag[2][TAGE_TABLES];
+    uint8_t hist[TAGE_HIST_BUFFER]; // Global history, newest bit at histPtr
+    unsigned histPtr;
+    int useAltOnNa;           // 4-bit signed: trust the alternate prediction of new entries
+    uint32_t tick;            // Branches since the last useful counter decay
+} tage_state;
+
+typedef struct {
+    uint32_t bimodalIndex;
+    uint32_t index[TAGE_TABLES];
+    uint16_t tag[TAGE_TABLES];
+    int provider;             // Longest matching table, -1 for the bimodal predictor
+    int alt;                  // Next matching table, -1 for the bimodal predictor
+    bool providerTaken;       // Prediction of the provider
+    bool altTaken;            // Prediction of the alternate
+    bool taken;               // Final prediction
+} tage_lookup_t;
+
+static void folded_init(tage_folded *f, unsigned olen, unsigned clen) {
+    f->comp = 0;
+    f->olen = olen;
+    f->clen = clen;
+    f->outpoint = olen % clen;
+}
+
+static inline void folded_update(tage_folded *f, const uint8_t *hist, unsigned ptr) {
+    f->comp = (f->comp << 1) ^ hist[ptr];
+    f->comp ^= (uint32_t)hist[(ptr + f->olen) & (TAGE_HIST_BUFFER - 1)] << f->outpoint;
+    f->comp ^= f->comp >> f->clen;
+    f->comp &= (1u << f->clen) - 1;
+}
+
+static inline tage_lookup_t tage_lookup(tage_state *st, uint32_t pc) {
+    tage_lookup_t l;
+    uint32_t pcBits = pc >> 2;
+    l.bimodalIndex = pcBits & st->bimodalMask;
+    l.provider = -1;
+    l.alt = -1;
+    for (int t = 0; t < TAGE_TABLES; ++t) {
+        l.index[t] = (pcBits ^ (pcBits >> (st->tableBits - t)) ^ st->foldIndex[t].comp) & st->tableMask;
+        l.tag[t] = (pcBits ^ st->foldTag[0][t].comp ^ (st->foldTag[1][t].comp << 1)) & st->tagMask[t];
+    }
+    for (int t = TAGE_TABLES - 1; t >= 0; --t) {
+        if (st->tables[t][l.index[t]].tag == l.tag[t]) {
+            if (l.provider < 0) {
+                l.provider = t;
+            } else {
+                l.alt = t;
+                break;
+            }
+        }
+    }
+
+    l.altTaken = l.alt >= 0 ? st->tables[l.alt][l.index[l.alt]].ctr >= 0
+                            : st->bimodal[l.bimodalIndex] >= 2;
+    if (l.provider < 0) {
+        l.providerTaken = l.altTaken;
+        l.taken = l.altTaken;
+        return l;
+    }
+    const tage_entry *e = &st->tables[l.provider][l.index[l.provider]];
+    l.providerTaken = e->ctr >= 0;
+    bool newEntry = (e->ctr == 0 || e->ctr == -1) && e->u == 0;
+    l.taken = (newEntry && st->useAltOnNa >= 0) ? l.altTaken : l.providerTaken;
+    return l;
+}
+
+static inline void tage_train(tage_state *st, const tage_lookup_t *l, bool taken) {
+    if (l->provider >= 0) {
+        tage_entry *e = &st->tables[l->provider][l->index[l->provider]];
+        bool newEntry = (e->ctr == 0 || e->ctr == -1) && e->u == 0;
+        if (newEntry && l->providerTaken != l->altTaken) {
+            st->useAltOnNa = sat_update(st->useAltOnNa, l->altTaken == taken, -8, 7);
+        }
+        if (l->providerTaken != l->altTaken) {
+            e->u = (uint8_t)sat_update(e->u, l->providerTaken == taken, 0, 3);
+        }
+        e->ctr = (int8_t)sat_update(e->ctr, taken, -4, 3);
+    } else {
+        st->bimodal[l->bimodalIndex] = counter2_update(st->bimodal[l->bimodalIndex], taken);
+    }
+
+    // Allocate an entry with a longer history on a misprediction
+    if (l->taken != taken && l->provider < TAGE_TABLES - 1) {
+        bool allocated = false;
+        for (int t = l->provider + 1; t < TAGE_TABLES; ++t) {
+            tage_entry *e = &st->tables[t][l->index[t]];
+            if (e->u == 0) {
+                e->tag = l->tag[t];
+                e->ctr = taken ? 0 : -1;
+                allocated = true;
+                break;
+            }
+        }
+        if (!allocated) {
+            for (int t = l->provider + 1; t < TAGE_TABLES; ++t) {
+                tage_entry *e = &st->tables[t][l->index[t]];
+                e->u -= e->u > 0;
+            }
+        }
+    }
+
+    // Gracefully age the useful counters
+    if (++st->tick == TAGE_U_RESET_PERIOD) {
+        st->tick = 0;
+        for (int t = 0; t < TAGE_TABLES; ++t) {
+            for (uint32_t i = 0; i <= st->tableMask; ++i) {
+                st->tables[t][i].u >>= 1;
+            }
+        }
+    }
+
+    // Push the outcome into the global history and the folded registers
+    st->histPtr = (st->histPtr - 1) & (TAGE_HIST_BUFFER - 1);
+    st->hist[st->histPtr] = taken;
+    for (int t = 0; t < TAGE_TABLES; ++t) {
+        folded_update(&st->foldIndex[t], st->hist, st->histPtr);
+        folded_update(&st->foldTag[0][t], st->hist, st->histPtr);
+        folded_update(&st->foldTag[1][t], st->hist, st->histPtr);
+    }
+}
+
+/*************************************************************************/
+/* Kernels                                                               */
+/*************************************************************************/
+
+// Instantiate the predict/update/run kernels of an engine from its lookup
+// and train functions. The lookup of the last prediction is kept in the
+// engine so that BP_ctx_update does not repeat it.
+#define BP_ENGINE_KERNELS(NAME) \
+typedef struct { \
+    NAME##_state st; \
+    NAME##_lookup_t last; \
+    uint32_t lastPc; \
+    bool lastValid; \
+} NAME##_engine; \
+static bool NAME##_predict(BP *bp, uint32_t pc, uint32_t *dst) { \
+    NAME##_engine *eng = (NAME##_engine *)bp->engine; \
+    eng->last = NAME##_lookup(&eng->st, pc); \
+    eng->lastPc = pc; \
+    eng->lastValid = true; \
+    uint32_t target; \
+    bool taken = btb_lookup(&eng->st.btb, pc, &target) && eng->last.taken; \
+    *dst = taken ? target : pc + 4; \
+    return taken; \
+} \
+static void NAME##_update(BP *bp, uint32_t pc, uint32_t targetPc, bool taken, uint32_t pred_dst) { \
+    NAME##_engine *eng = (NAME##_engine *)bp->engine; \
+    if (!eng->lastValid || eng->lastPc != pc) { \
+        eng->last = NAME##_lookup(&eng->st, pc); \
+    } \
+    eng->lastValid = false; \
+    bool misprediction = pred_dst != (taken ? targetPc : pc + 4); \
+    NAME##_train(&eng->st, &eng->last, taken); \
+    btb_update(&eng->st.btb, pc, targetPc, misprediction); \
+    bp->stats.flush_num += misprediction; \
+    bp->stats.br_num++; \
+} \
+static void NAME##_run(BP *bp, const BP_branch *br, size_t num, BP_prediction *pred) { \
+    NAME##_engine *eng = (NAME##_engine *)bp->engine; \
+    NAME##_state *st = &eng->st; \
+    for (size_t i = 0; i < num; ++i) { \
+        uint32_t pc = br[i].pc; \
+        NAME##_lookup_t l = NAME##_lookup(st, pc); \
+        uint32_t target; \
+        bool predTaken = btb_lookup(&st->btb, pc, &target) && l.taken; \
+        uint32_t dst = predTaken ? target : pc + 4; \
+        if (pred) { \
+            pred[i].dst = dst; \
+            pred[i].taken = predTaken; \
+        } \
+        bool misprediction = dst != (br[i].taken ? br[i].targetPc : pc + 4); \
+        NAME##_train(st, &l, br[i].taken); \
+        btb_update(&st->btb, pc, br[i].targetPc, misprediction); \
+        bp->stats.flush_num += misprediction; \
+    } \
+    bp->stats.br_num += num; \
+    eng->lastValid = false; \
+} \
+static bool NAME##_probe(const BP *bp, uint32_t pc) { \
+    uint32_t target; \
+    return btb_lookup(&((const NAME##_engine *)bp->engine)->st.btb, pc, &target); \
+} \
+static const BP_kernel NAME##_kernel = { NAME##_predict, NAME##_update, NAME##_run, NAME##_probe };
+
+BP_ENGINE_KERNELS(gshare)
+BP_ENGINE_KERNELS(perceptron)
+BP_ENGINE_KERNELS(tage)
+
+/*************************************************************************/
+/* Creation                                                              */
+/*************************************************************************/
+
+// Allocate a context with room for the engine structure and its tables
+static BP *engine_alloc(size_t engineSize, size_t tableBytes, bp_arena *arena) {
+    size_t bytes = arena_size(sizeof(BP)) + arena_size(engineSize) + tableBytes;
+    BP *bp = (BP *)calloc(1, bytes);
+    if (!bp) return NULL;
+    arena->next = (char *)bp;
+    arena_take(arena, sizeof(BP));
+    bp->engine = arena_take(arena, engineSize);
+    bp->footprint = bytes;
+    return bp;
+}
+
+static void btb_init(bp_btb *btb, const BP_engine_config *cfg, bp_arena *arena) {
+    size_t entries = (size_t)1 << cfg->btbBits;
+    btb->tags = (uint32_t *)arena_take(arena, entries * sizeof(uint32_t));
+    btb->targets = (uint32_t *)arena_take(arena, entries * sizeof(uint32_t));
+    btb->mask = entries - 1;
+    btb->tagShift = 2 + cfg->btbBits;
+    btb->tagMask = (1u << cfg->tagSize) - 1;
+}
+
+static size_t btb_bytes(const BP_engine_config *cfg) {
+    return 2 * arena_size(((size_t)1 << cfg->btbBits) * sizeof(uint32_t));
+}
+
+static unsigned btb_bits(const BP_engine_config *cfg) {
+    return (cfg->tagSize + BP_TARGET_SIZE + 1) << cfg->btbBits;
+}
+
+static BP *gshare_create(const BP_engine_config *cfg) {
+    if (cfg->historySize < 1 || cfg->historySize > 32) return NULL;
+    size_t entries = (size_t)1 << cfg->tableBits;
+    bp_arena arena;
+    BP *bp = engine_alloc(sizeof(gshare_engine), btb_bytes(cfg) + arena_size(entries), &arena);
+    if (!bp) return NULL;
+    gshare_state *st = &((gshare_engine *)bp->engine)->st;
+    btb_init(&st->btb, cfg, &arena);
+    st->counters = (uint8_t *)arena_take(&arena, entries);
+    memset(st->counters, 1, entries);
+    st->mask = entries - 1;
+    st->histMask = cfg->historySize == 32 ? 0xffffffffu : (1u << cfg->historySize) - 1;
+    bp->kernel = gshare_kernel;
+    bp->stats.size = 2 * entries + cfg->historySize + btb_bits(cfg);
+    return bp;
+}
+
+static BP *perceptron_create(const BP_engine_config *cfg) {
+    if (cfg->historySize < PERCEPTRON_TABLES || cfg->historySize > 64) return NULL;
+    size_t entries = (size_t)1 << cfg->tableBits;
+    bp_arena arena;
+    BP *bp = engine_alloc(sizeof(perceptron_engine),
+                          btb_bytes(cfg) + arena_size(entries * PERCEPTRON_TABLES), &arena);
+    if (!bp) return NULL;
+    perceptron_state *st = &((perceptron_engine *)bp->engine)->st;
+    btb_init(&st->btb, cfg, &arena);
+    st->weights = (int8_t *)arena_take(&arena, entries * PERCEPTRON_TABLES);
+    st->mask = entries - 1;
+    st->tableBits = cfg->tableBits;
+    st->histMask = cfg->historySize == 64 ? ~0ull : (1ull << cfg->historySize) - 1;
+
+    // Table 0 is the bias weight (no history); the others use geometric
+    // history prefixes from 2 bits up to historySize
+    st->segMask[0] = 0;
+    for (unsigned t = 1; t < PERCEPTRON_TABLES; ++t) {
+        double ratio = (double)cfg->historySize / 2;
+        unsigned len = (unsigned)(2 * pow(ratio, (double)(t - 1) / (PERCEPTRON_TABLES - 2)) + 0.5);
+        st->segMask[t] = len >= 64 ? ~0ull : (1ull << len) - 1;
+    }
+    bp->kernel = perceptron_kernel;
+    bp->stats.size = 8 * entries * PERCEPTRON_TABLES + cfg->historySize + btb_bits(cfg);
+    return bp;
+}
+
+static BP *tage_create(const BP_engine_config *cfg) {
+    if (cfg->historySize < 2 * TAGE_MIN_HIST || cfg->historySize >= TAGE_HIST_BUFFER) return NULL;
+    size_t bimodalEntries = (size_t)1 << cfg->tableBits;
+    unsigned tableBits = cfg->tableBits - 1;
+    size_t tableEntries = (size_t)1 << tableBits;
+    size_t tableBytes = arena_size(bimodalEntries) + TAGE_TABLES * arena_size(tableEntries * sizeof(tage_entry));
+    bp_arena arena;
+    BP *bp = engine_alloc(sizeof(tage_engine), btb_bytes(cfg) + tableBytes, &arena);
+    if (!bp) return NULL;
+    tage_state *st = &((tage_engine *)bp->engine)->st;
+    btb_init(&st->btb, cfg, &arena);
+    st->bimodal = (uint8_t *)arena_take(&arena, bimodalEntries);
+    memset(st->bimodal, 1, bimodalEntries);
+    st->bimodalMask = bimodalEntries - 1;
+    st->tableMask = tableEntries - 1;
+    st->tableBits = tableBits;
+
+    unsigned size = 2 * bimodalEntries + cfg->historySize + 4 + btb_bits(cfg);
+    double ratio = (double)cfg->historySize / TAGE_MIN_HIST;
+    for (int t = 0; t < TAGE_TABLES; ++t) {
+        // Geometric history lengths from TAGE_MIN_HIST to historySize
+        unsigned hist = (unsigned)(TAGE_MIN_HIST * pow(ratio, (double)t / (TAGE_TABLES - 1)) + 0.5);
+        unsigned tagBits = 8 + t;
+        st->tables[t] = (tage_entry *)arena_take(&arena, tableEntries * sizeof(tage_entry));
+        st->tagMask[t] = (uint16_t)((1u << tagBits) - 1);
+        folded_init(&st->foldIndex[t], hist, tableBits);
+        folded_init(&st->foldTag[0][t], hist, tagBits);
+        folded_init(&st->foldTag[1][t], hist, tagBits - 1);
+        size += (3 + 2 + tagBits) * tableEntries;
+    }
+    bp->kernel = tage_kernel;
+    bp->stats.size = size;
+    return bp;
+}
+
+BP_ctx *BP_create_engine(const BP_engine_config *cfg) {
+    if (!cfg) return NULL;
+    if (cfg->btbBits > 16 || cfg->tagSize > 30 - cfg->btbBits) return NULL;
+    if (cfg->tableBits < 4 || cfg->tableBits > 22) return NULL;
+    switch (cfg->kind) {
+    case BP_ENGINE_GSHARE:
+        return gshare_create(cfg);
+    case BP_ENGINE_PERCEPTRON:
+        return perceptron_create(cfg);
+    case BP_ENGINE_TAGE:
+        return tage_create(cfg);
+    }
+    return NULL;
+}
@@ -0,0 +1,85 @@
+/* 046267 Computer Architecture - HW #1 */
+/* Predictor context layout shared by bp.c and the predictor engines */
+
+#ifndef BP_INTERNAL_H_
+#define BP_INTERNAL_H_
+
+#include "bp_api.h"
+
+typedef struct BP_ctx BP;
+
+// Predict/update kernels of a predictor, picked once by BP_create
+typedef bool (*BP_predict_fn)(BP *bp, uint32_t pc, uint32_t *dst);
+typedef void (*BP_update_fn)(BP *bp, uint32_t pc, uint32_t targetPc, bool taken, uint32_t pred_dst);
+typedef void (*BP_run_fn)(BP *bp, const BP_branch *br, size_t num, BP_prediction *pred);
+// Whether the BTB holds an entry for pc; only the profiler calls it
+typedef bool (*BP_probe_fn)(const BP *bp, uint32_t pc);
+
+typedef struct {
+    BP_predict_fn predict;
+    BP_update_fn update;
+    BP_run_fn run;
+    BP_probe_fn probe;
+} BP_kernel;
+
+typedef struct BP_profile BP_profile;
+
+// Structure representing the Branch Predictor (opaque BP_ctx in bp_api.h)
+// For the two-level predictor, all tables live in one arena allocated right
+// after the structure, in struct-of-arrays form: BTB tags, BTB targets,
+// history registers and the 2-bit FSM counters (one byte each).
+// A set-associative or hashed BTB (bp_btb.c) adds its replacement state to
+// the arena; its entries are grouped by set, so the btbWays tags of a set are
+// contiguous, and history registers and FSM tables follow the BTB entries.
+// Engine predictors (bp_engines.c) keep their state in the same allocation,
+// pointed to by engine, and only use the kernel, footprint and stats fields.
+struct BP_ctx {
+    uint32_t *tags;           // BTB tags, one per BTB entry
+    uint32_t *targets;        // BTB target addresses, one per BTB entry
+    uint32_t *histories;      // History registers (a single one when global)
+    uint8_t *fsm;             // FSM tables (a single one when global)
+    unsigned btbSize;         // Size of the BTB
+    unsigned historySize;     // Size of the history
+    unsigned tagSize;         // Size of the tag
+    unsigned fsmState;        // Initial FSM state
+    bool isGlobalHist;        // Flag for global history
+    bool isGlobalTable;       // Flag for global FSM table
+    int Shared;               // Sharing mode
+    unsigned tableSize;       // Number of FSMs in a single table
+    unsigned btbMask;         // BTB set index mask (btbSize / btbWays - 1)
+    unsigned tagShift;        // PC shift to the tag bits (2 + log2(btbSize / btbWays))
+    uint32_t tagMask;         // Tag mask ((1 << tagSize) - 1)
+    unsigned histMask;        // History mask ((1 << historySize) - 1)
+    unsigned btbWays;         // BTB associativity (1 for the direct-mapped BTB)
+    bool btbHash;             // XOR-hashed BTB set index
+    unsigned hashMask;        // Tag bits folded into the set index (0 when not hashed)
+    unsigned histStride;      // History register step per BTB entry (0 or 1)
+    unsigned tableStride;     // FSM table step per BTB entry (0 or tableSize)
+    unsigned shareShift;      // PC shift of the share bits (2 lsb, 16 mid)
+    unsigned shareMask;       // Share bits mask (0 when not using share)
+    uint8_t *ages;            // LRU age of each BTB entry (0 most recent)
+    uint16_t *plru;           // Tree PLRU bits of each BTB set
+    BP_kernel kernel;         // Kernels in use (specialized, generic or an engine's)
+    void *engine;             // State of a BP_create_engine predictor, NULL for the two-level one
+    BP_profile *profile;      // Per-PC profile (bp_profile.c), NULL when profiling is off
+    size_t footprint;         // Bytes allocated for the context and its arena
+    SIM_stats stats;          // Statistics for the simulation
+};
+
+// Valid bit of a tag stored by a set-associative or hashed BTB (tags have at most 30 bits)
+#define BTB_VALID 0x80000000u
+
+// Theoretical size of a two-level predictor configuration, in bits
+unsigned bp_theoretical_size(const BP_config *cfg);
+
+// Create a two-level predictor with a set-associative and/or hashed BTB
+// (bp_btb.c); cfg was already validated by BP_create
+BP *bp_create_assoc(const BP_config *cfg);
+
+// Switch the kernels of a context; when profiling, the profiler keeps wrapping them (bp_profile.c)
+void bp_set_kernel(BP *bp, const BP_kernel *kernel);
+
+// Release the per-PC profile of a context (bp_profile.c)
+void bp_profile_free(BP_profile *profile);
+
+#endif /* BP_INTERNAL_H_ */
@@ -1,117 +1,799 @@
 /* 046267 Computer Architecture - HW #1 */
 /* Main program                     	*/
 /* Usage: ./bp_main <trace filename>  	*/
+/*        ./bp_main --sweep <config list> [--threads N] <trace filename> */
+/* A trace filename of - reads the trace from stdin; pipes and FIFOs    */
+/* are read in batches, so memory use does not grow with the trace      */
+/* --profile N prints the N branches with the most flushes after the  */
+/* stats, --profile-dump <file> writes the whole per-PC profile as CSV  */
+/* --checkpoint-in <file> starts from a saved predictor state (the     */
+/* stats count only this run's branches) and                            */
+/* --checkpoint-out <file> saves the state at the end of the run        */
+/* --sample P,W,D simulates W branches of warm-up and then D detailed   */
+/* branches at the end of every P, and extrapolates flush_num with a    */
+/* 95% confidence interval; the other branches of each period only      */
+/* warm the predictor (functional warming), or are skipped altogether   */
+/* with --sample-skip                                                   */
+/* --interval N also prints the flushes of every N branches (not in   */
+/* sweeps), as soon as each interval ends                               */
+/* --footprint also reports the bytes allocated for each predictor      */
+/* --quiet skips the per-branch output and prints only the final stats  */
+/* Sweeps run configs sharing a BTB geometry in lockstep (BP_multi),    */
+/* unless --no-lockstep asks for one independent predictor per config   */
+/* --engine <gshare|perceptron|tage>[:btb=N,tag=N,table=N,hist=N] runs  */
+/* a predictor engine instead of the trace's two-level configuration    */
+/* The trace may be a text trace or a binary trace made by bp_trconv    */
+/* A config line may end with BTB options (ways=N, lru/plru, hash); such */
+/* configs, and BTBs above 32 entries, run on a context (BP_create)     */
+
+#define _POSIX_C_SOURCE 200809L
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <math.h>
 
 #include "bp_api.h"
+#include "bp_trace.h"
 
-int main(int argc, char **argv) {
+#define OUTPUT_BUFFER_SIZE (1 << 20)  // stdout is written through one large buffer
+#define BATCH_SIZE 65536              // Branch records per BP_ctx_run call
+#define SWEEP_BATCH_SIZE (1 << 20)    // Branch records handed to the sweep threads at once
+#define INPUT_BUFFER_SIZE (1 << 20)   // Streamed traces are read through one large buffer
+#define LOCKSTEP_LANES 16             // Maximal number of configs per lockstep task
 
-	if (argc < 2) {
-		fprintf(stderr, "Usage: %s <trace filename>\n", argv[0]);
-		exit(1);
-	}
+/* Branch source: a mapped binary trace, or a text or binary trace read as a stream */
+typedef struct {
+	BP_stream stream;             // Streamed trace (stream.file is NULL for a mapped trace)
+	BP_bin_trace bin;             // Mapped binary trace
+	size_t next;                  // Next record of the mapped trace
+	size_t batchSize;             // Maximal records per batch
+	BP_branch *buf;               // Batch buffer for the streamed trace
+	bool done;                    // The streamed trace ended
+	char config[256];             // Config line of the trace
+} trace_input;
 
-	FILE *trace = fopen(argv[1], "r");
-	if (trace == 0) {
-		fprintf(stderr, "cannot open trace file\n");
-		exit(2);
+static void open_input(const char *filename, trace_input *in, size_t batchSize) {
+	memset(in, 0, sizeof(*in));
+	in->batchSize = batchSize;
+	FILE *file = stdin;
+	if (strcmp(filename, "-") != 0) {
+		// Regular binary files are mapped; anything else is read as a stream
+		int err = BP_bin_open(filename, &in->bin);
+		if (err == 0) {
+			memcpy(in->config, in->bin.config, sizeof(in->config));
+			return;
+		}
+		if (err < 0) {
+			fprintf(stderr, "Error in input file: bad binary trace\n");
+			exit(9);
+		}
+		file = fopen(filename, "r");
+		if (file == 0) {
+			fprintf(stderr, "cannot open trace file\n");
+			exit(2);
+		}
 	}
+	setvbuf(file, NULL, _IOFBF, INPUT_BUFFER_SIZE);
 
-	char line[1024];
-	if (fgets(line, 256, trace) == NULL) {
+	int err = BP_stream_open(file, &in->stream);
+	if (err == 3) {
 		fprintf(stderr, "Error in input file: cannot read config\n");
 		exit(3);
+	} else if (err) {
+		fprintf(stderr, "Error in input file: bad binary trace\n");
+		exit(err);
 	}
-	char *elemnts[7];
-	int i = 0;
-	elemnts[0] = strtok(line, " ");
-	for (i = 1; i < 7; ++i) {
-		elemnts[i] = strtok(NULL, " \n");
+	memcpy(in->config, in->stream.config, sizeof(in->config));
+	in->buf = (BP_branch *)malloc(batchSize * sizeof(BP_branch));
+	if (!in->buf) {
+		fprintf(stderr, "out of memory\n");
+		exit(10);
 	}
+}
 
-	int btbSize = strtoul(elemnts[0], NULL, 0);
-	int historySize = strtoul(elemnts[1], NULL, 0);
-	int tagSize = strtoul(elemnts[2], NULL, 0);
-	int fsmState =strtoul(elemnts[3], NULL, 0);
-	if (btbSize == 0 || historySize == 0) {
-		fprintf(stderr, "Error in input file: cannot read config\n");
-		exit(4);
+/* Get the next batch of records (0 once the trace ended); mapped traces are not copied */
+static size_t next_batch(trace_input *in, const BP_branch **batch) {
+	if (!in->stream.file) {
+		size_t num = in->bin.num - in->next;
+		if (num > in->batchSize) num = in->batchSize;
+		*batch = in->bin.br + in->next;
+		in->next += num;
+		return num;
 	}
-	bool isGlobalHist;
-	if (strcmp(elemnts[4], "local_history") == 0) {
-		isGlobalHist = false;
-	} else if (strcmp(elemnts[4], "global_history") == 0) {
-		isGlobalHist = true;
-	} else {
-		fprintf(stderr, "Error in input file: cannot read config\n");
-		exit(5);
+	if (in->done) return 0;
+	long num = BP_stream_read(&in->stream, in->buf, in->batchSize);
+	if (num < 0) {
+		fprintf(stderr, "Error in input file: bad trace\n");
+		exit(9);
 	}
-	bool isGlobalTable;
-	if (strcmp(elemnts[5], "local_tables") == 0) {
-		isGlobalTable = false;
-	} else if (strcmp(elemnts[5], "global_tables") == 0) {
-		isGlobalTable = true;
+	in->done = (size_t)num < in->batchSize;
+	*batch = in->buf;
+	return num;
+}
+
+static void close_input(trace_input *in) {
+	if (in->stream.file) {
+		if (in->stream.file != stdin) fclose(in->stream.file);
 	} else {
-		fprintf(stderr, "Error in input file: cannot read config\n");
-		exit(6);
-	}
-	int Shared;
-	if (strcmp(elemnts[6], "using_share_lsb") == 0) {
-		Shared = 1;
-  } else if (strcmp(elemnts[6], "using_share_mid") == 0) {
-		Shared = 2;
-	} else if (strcmp(elemnts[6], "not_using_share") == 0) {
-		Shared = 0;
+		BP_bin_close(&in->bin);
+	}
+	free(in->buf);
+}
+
+/* Interval statistics: the stats of every fixed-length run of branches */
+typedef struct {
+	unsigned long every;          // Interval length in branches, 0 when off
+	unsigned long pending;        // Branches run since the previous report
+	unsigned index;               // Number of intervals reported
+	SIM_stats last;               // Stats at the previous report
+} interval_stats;
+
+/* Number of the next num branches that still belong to the current interval */
+static size_t interval_room(const interval_stats *iv, size_t num) {
+	if (!iv->every || iv->every - iv->pending >= num) return num;
+	return iv->every - iv->pending;
+}
+
+/* Print the interval ending at the snapshot now, and start the next one */
+static void interval_report(interval_stats *iv, const SIM_stats *now) {
+	unsigned branches = now->br_num - iv->last.br_num;
+	unsigned flushes = now->flush_num - iv->last.flush_num;
+	printf("interval %u: br_num: %u, flush_num: %u, flushes per Mbr: %.1f\n",
+			iv->index++, branches, flushes, branches ? 1e6 * flushes / branches : 0.0);
+	fflush(stdout); // Intervals show up while a streamed trace is still running
+	iv->last = *now;
+	iv->pending = 0;
+}
+
+/* A single configuration of a sweep and its results */
+typedef struct {
+	char name[256];               // Config line as given in the config list
+	BP_config cfg;
+	BP_ctx *ctx;                  // Predictor of the job, when it does not run in lockstep
+	SIM_stats stats;
+	size_t footprint;             // Bytes allocated for the predictor
+	bool failed;                  // Predictor init failed
+} sweep_job;
+
+/* A unit of sweep work: configs sharing a BTB geometry, run in lockstep */
+/* (a config with a set-associative or hashed BTB is a task of its own) */
+typedef struct {
+	size_t first;                 // First job of the task in sweep_pool.order
+	unsigned num;                 // Number of jobs of the task
+	BP_multi *multi;              // Lockstep engine, NULL when each job has its own context
+} sweep_task;
+
+/* State shared by the sweep worker threads */
+typedef struct {
+	const BP_branch *br;          // Current batch of branches
+	size_t num_br;
+	sweep_job *jobs;
+	size_t *order;                // Job indices, grouped by BTB geometry
+	sweep_task *tasks;
+	size_t num_tasks;
+	size_t next_task;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;          // A batch is ready, or the sweep is done
+	pthread_cond_t idle;          // The workers finished the batch
+	unsigned generation;          // Number of batches handed to the workers
+	long busy;                    // Workers still running the current batch
+	bool done;
+} sweep_pool;
+
+/* BP_multi only simulates the direct-mapped, unhashed BTB */
+static bool lockstep_capable(const BP_config *cfg) {
+	return cfg->btbWays <= 1 && !cfg->btbHash;
+}
+
+/* Create the predictors of a task; they live until the whole trace ran */
+static void setup_task(const sweep_pool *pool, sweep_task *task, bool lockstep) {
+	const size_t *order = pool->order + task->first;
+	if (lockstep && lockstep_capable(&pool->jobs[order[0]].cfg)) {
+		BP_config cfgs[LOCKSTEP_LANES];
+		for (unsigned i = 0; i < task->num; ++i) {
+			cfgs[i] = pool->jobs[order[i]].cfg;
+		}
+		task->multi = BP_multi_create(cfgs, task->num);
+		for (unsigned i = 0; !task->multi && i < task->num; ++i) {
+			pool->jobs[order[i]].failed = true;
+		}
+		return;
+	}
+	for (unsigned i = 0; i < task->num; ++i) {
+		sweep_job *job = &pool->jobs[order[i]];
+		job->ctx = BP_create(&job->cfg);
+		job->failed = !job->ctx;
+	}
+}
+
+static void run_task(const sweep_pool *pool, const sweep_task *task) {
+	const size_t *order = pool->order + task->first;
+	if (task->multi) {
+		BP_multi_run(task->multi, pool->br, pool->num_br);
+		return;
+	}
+	for (unsigned i = 0; i < task->num; ++i) {
+		BP_ctx *ctx = pool->jobs[order[i]].ctx;
+		if (ctx) BP_ctx_run(ctx, pool->br, pool->num_br, NULL);
+	}
+}
+
+/* Collect the stats of a task and release its predictors */
+static void finish_task(const sweep_pool *pool, sweep_task *task) {
+	const size_t *order = pool->order + task->first;
+	for (unsigned i = 0; i < task->num; ++i) {
+		sweep_job *job = &pool->jobs[order[i]];
+		if (task->multi) {
+			BP_multi_stats(task->multi, i, &job->stats);
+		} else if (job->ctx) {
+			BP_ctx_stats(job->ctx, &job->stats);
+			BP_destroy(job->ctx);
+			job->ctx = NULL;
+		}
+	}
+	BP_multi_destroy(task->multi);
+	task->multi = NULL;
+}
+
+/* Take tasks of the current batch until none is left */
+static void run_tasks(sweep_pool *pool) {
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		size_t task = pool->next_task++;
+		pthread_mutex_unlock(&pool->lock);
+		if (task >= pool->num_tasks) break;
+		run_task(pool, &pool->tasks[task]);
+	}
+}
+
+/* A worker lives for the whole sweep, running its share of every batch */
+static void *sweep_worker(void *arg) {
+	sweep_pool *pool = (sweep_pool *)arg;
+	unsigned seen = 0;
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (pool->generation == seen && !pool->done) {
+			pthread_cond_wait(&pool->wake, &pool->lock);
+		}
+		if (pool->done) break;
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+		run_tasks(pool);
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->busy == 0) pthread_cond_signal(&pool->idle);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+/* Run every task over the current batch, on the calling thread and the workers */
+static void run_batch(sweep_pool *pool, long workers) {
+	pthread_mutex_lock(&pool->lock);
+	pool->next_task = 0;
+	pool->busy = workers;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	run_tasks(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->busy > 0) {
+		pthread_cond_wait(&pool->idle, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static int compare_keys(const void *a, const void *b) {
+	uint64_t ka = *(const uint64_t *)a, kb = *(const uint64_t *)b;
+	return ka < kb ? -1 : ka > kb;
+}
+
+/* Check every job, then group the valid ones into tasks of equal BTB geometry */
+static size_t plan_tasks(sweep_job *jobs, size_t num_jobs, long threads,
+		size_t *order, sweep_task *tasks) {
+	uint64_t *keys = (uint64_t *)malloc(sizeof(uint64_t) * (num_jobs + 1));
+	if (!keys) {
+		fprintf(stderr, "out of memory\n");
+		exit(10);
+	}
+	size_t valid = 0;
+	for (size_t i = 0; i < num_jobs; ++i) {
+		BP_ctx *ctx = BP_create(&jobs[i].cfg);
+		if (!ctx) {
+			jobs[i].failed = true;
+			continue;
+		}
+		jobs[i].footprint = BP_ctx_footprint(ctx);
+		BP_destroy(ctx);
+		keys[valid++] = ((uint64_t)jobs[i].cfg.btbSize << 40) | ((uint64_t)jobs[i].cfg.tagSize << 32) | i;
+	}
+	qsort(keys, valid, sizeof(uint64_t), compare_keys);
+
+	// Narrow the tasks when there are few configs, to keep every thread busy
+	size_t width = (valid + threads - 1) / threads;
+	if (width > LOCKSTEP_LANES) width = LOCKSTEP_LANES;
+	if (width < 1) width = 1;
+
+	size_t num_tasks = 0;
+	for (size_t i = 0; i < valid; ++i) {
+		order[i] = keys[i] & ((1ull << 32) - 1);
+		bool sameGeometry = i > 0 && (keys[i] >> 32) == (keys[i - 1] >> 32) &&
+				lockstep_capable(&jobs[order[i]].cfg) && lockstep_capable(&jobs[order[i - 1]].cfg);
+		if (num_tasks > 0 && sameGeometry && tasks[num_tasks - 1].num < width) {
+			tasks[num_tasks - 1].num++;
+		} else {
+			tasks[num_tasks].first = i;
+			tasks[num_tasks].num = 1;
+			num_tasks++;
+		}
+	}
+	free(keys);
+	return num_tasks;
+}
+
+/* Read a config list: one trace config line per line, '#' starts a comment */
+static sweep_job *read_config_list(const char *filename, size_t *num_jobs) {
+	FILE *list = fopen(filename, "r");
+	if (list == 0) {
+		fprintf(stderr, "cannot open config list\n");
+		exit(2);
+	}
+	size_t num = 0, cap = 0;
+	sweep_job *jobs = NULL;
+	char line[1024];
+	while (fgets(line, sizeof(line), list) != NULL) {
+		if (line[0] == '\n' || line[0] == '#') continue;
+		if (num == cap) {
+			cap = cap ? 2 * cap : 64;
+			jobs = (sweep_job *)realloc(jobs, cap * sizeof(sweep_job));
+			if (!jobs) {
+				fprintf(stderr, "out of memory\n");
+				exit(10);
+			}
+		}
+		sweep_job *job = &jobs[num];
+		memset(job, 0, sizeof(*job));
+		size_t len = strcspn(line, "\n");
+		if (len >= sizeof(job->name)) len = sizeof(job->name) - 1;
+		memcpy(job->name, line, len);
+		int err = BP_parse_config(line, &job->cfg);
+		if (err) {
+			fprintf(stderr, "Error in config list: cannot read config: %s\n", job->name);
+			exit(err);
+		}
+		num++;
+	}
+	fclose(list);
+	*num_jobs = num;
+	return jobs;
+}
+
+/* Run every config of the list over the trace on a pool of threads */
+static int run_sweep(trace_input *in, const char *configList, long threads, bool footprint, bool lockstep) {
+	size_t num_jobs = 0;
+	sweep_job *jobs = read_config_list(configList, &num_jobs);
+
+	if (threads <= 0) {
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (threads <= 0) threads = 1;
+	}
+
+	size_t *order = (size_t *)malloc(sizeof(size_t) * (num_jobs + 1));
+	sweep_task *tasks = (sweep_task *)calloc(num_jobs + 1, sizeof(sweep_task));
+	if (!order || !tasks) {
+		fprintf(stderr, "out of memory\n");
+		exit(10);
+	}
+	size_t num_tasks = plan_tasks(jobs, num_jobs, lockstep ? threads : (long)num_jobs + 1, order, tasks);
+	if ((size_t)threads > num_tasks) threads = num_tasks ? (long)num_tasks : 1;
+
+	sweep_pool pool = { NULL, 0, jobs, order, tasks, num_tasks, 0, PTHREAD_MUTEX_INITIALIZER,
+			PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, false };
+	for (size_t t = 0; t < num_tasks; ++t) {
+		setup_task(&pool, &tasks[t], lockstep);
+	}
+	// The calling thread is one of the threads; the others wait for each batch
+	pthread_t *workers = (pthread_t *)malloc(sizeof(pthread_t) * threads);
+	if (!workers) {
+		fprintf(stderr, "out of memory\n");
+		exit(10);
+	}
+	long started = 0;
+	for (; started < threads - 1; ++started) {
+		if (pthread_create(&workers[started], NULL, sweep_worker, &pool) != 0) break;
+	}
+
+	// The predictors persist across batches, so only one batch of a streamed trace is held
+	while ((pool.num_br = next_batch(in, &pool.br)) > 0) {
+		run_batch(&pool, started);
+	}
+	pthread_mutex_lock(&pool.lock);
+	pool.done = true;
+	pthread_cond_broadcast(&pool.wake);
+	pthread_mutex_unlock(&pool.lock);
+	for (long t = 0; t < started; ++t) {
+		pthread_join(workers[t], NULL);
+	}
+	for (size_t t = 0; t < num_tasks; ++t) {
+		finish_task(&pool, &tasks[t]);
+	}
+
+	for (size_t i = 0; i < num_jobs; ++i) {
+		if (jobs[i].failed) {
+			printf("%s: Predictor init failed\n", jobs[i].name);
+		} else {
+			printf("%s: flush_num: %d, br_num: %d, size: %db", jobs[i].name,
+					jobs[i].stats.flush_num, jobs[i].stats.br_num, jobs[i].stats.size);
+			if (footprint) {
+				printf(", footprint: %zuB", jobs[i].footprint);
+			}
+			printf("\n");
+		}
+	}
+
+	free(workers);
+	free(tasks);
+	free(order);
+	free(jobs);
+	return 0;
+}
+
+/* Sampled simulation: in every period of P branches, fast-forward over P - W - D, warm up on W, measure D */
+typedef struct {
+	unsigned long period;         // P, 0 when not sampling
+	unsigned long warmup;         // W
+	unsigned long detail;         // D
+	bool skip;                    // Fast-forward by skipping the branches, not by functional warming
+} sample_plan;
+
+static void run_sampled(trace_input *in, BP_ctx *ctx, const sample_plan *plan, SIM_stats *stats) {
+	unsigned long skipEnd = plan->period - plan->warmup - plan->detail;
+	unsigned long warmEnd = plan->period - plan->detail;
+	unsigned long pos = 0;        // Position in the current period
+	uint64_t total = 0;           // Branches in the trace
+	unsigned samples = 0;
+	double sum = 0, sumSquares = 0; // Of the flush rates of the samples
+	SIM_stats start, now;
+	memset(&start, 0, sizeof(start));
+
+	const BP_branch *batch;
+	size_t num;
+	while ((num = next_batch(in, &batch)) > 0) {
+		for (size_t done = 0, part; done < num; done += part, pos = (pos + part) % plan->period) {
+			unsigned long end = pos < skipEnd ? skipEnd : pos < warmEnd ? warmEnd : plan->period;
+			part = end - pos < num - done ? end - pos : num - done;
+			// Fast-forward: the branches still train the predictor, unless skipped; only the
+			// stats of the detailed branches are used, so counting them does no harm
+			if (pos < skipEnd && plan->skip) continue;
+			if (pos == warmEnd) BP_ctx_stats(ctx, &start);
+			BP_ctx_run(ctx, batch + done, part, NULL);
+			if (pos + part == plan->period) {
+				BP_ctx_stats(ctx, &now);
+				double rate = (double)(now.flush_num - start.flush_num) / plan->detail;
+				sum += rate;
+				sumSquares += rate * rate;
+				samples++;
+			}
+		}
+		total += num;
+	}
+
+	// Extrapolate the mean flush rate of the samples to the whole trace
+	BP_ctx_stats(ctx, stats);
+	double mean = samples ? sum / samples : 0;
+	double estimate = mean * total;
+	stats->flush_num = (unsigned)(estimate + 0.5);
+	stats->br_num = (unsigned)total;
+	printf("sampled: %u intervals, %llu of %llu branches in detail", samples,
+			(unsigned long long)samples * plan->detail, (unsigned long long)total);
+	if (samples > 1) {
+		double variance = (sumSquares - samples * mean * mean) / (samples - 1);
+		double error = 1.96 * sqrt(variance > 0 ? variance : 0) / sqrt(samples) * total;
+		printf(", flush_num: %.0f +- %.0f (95%% confidence)\n", estimate, error);
 	} else {
-		fprintf(stderr, "Error in input file: cannot read config\n");
-		exit(7);
+		printf(", flush_num: %.0f (too few intervals for an error estimate)\n", estimate);
+	}
+}
+
+/* Load a checkpoint file into a context */
+static void read_checkpoint(BP_ctx *ctx, const char *filename) {
+	FILE *file = fopen(filename, "rb");
+	if (file == 0) {
+		fprintf(stderr, "cannot open checkpoint file\n");
+		exit(2);
 	}
+	size_t size = BP_ctx_checkpoint_size(ctx);
+	char *buf = (char *)malloc(size + 1);
+	if (!buf) {
+		fprintf(stderr, "out of memory\n");
+		exit(10);
+	}
+	// Read one byte more than expected to catch a checkpoint of another size
+	size_t got = fread(buf, 1, size + 1, file);
+	fclose(file);
+	if (size == 0 || BP_ctx_restore(ctx, buf, got) < 0) {
+		fprintf(stderr, "Error in checkpoint: does not match the predictor\n");
+		exit(12);
+	}
+	free(buf);
+}
 
-	if (BP_init(btbSize, historySize, tagSize,fsmState, isGlobalHist,
-			isGlobalTable, Shared) < 0) {
+/* Save the state of a context to a checkpoint file */
+static void write_checkpoint(const BP_ctx *ctx, const char *filename) {
+	size_t size = BP_ctx_checkpoint_size(ctx);
+	if (size == 0) {
+		fprintf(stderr, "Error in checkpoint: the predictor has no checkpoint support\n");
+		exit(12);
+	}
+	char *buf = (char *)malloc(size);
+	if (!buf) {
+		fprintf(stderr, "out of memory\n");
+		exit(10);
+	}
+	BP_ctx_checkpoint(ctx, buf, size);
+	FILE *file = fopen(filename, "wb");
+	if (file == 0) {
+		fprintf(stderr, "cannot open checkpoint file\n");
+		exit(2);
+	}
+	if (fwrite(buf, 1, size, file) != size || fclose(file) != 0) {
+		fprintf(stderr, "cannot write checkpoint file\n");
+		exit(11);
+	}
+	free(buf);
+}
+
+/* Print the top of a context's per-PC profile and/or dump all of it as CSV */
+static void report_profile(const BP_ctx *ctx, size_t top, const char *dumpFile) {
+	size_t num = BP_ctx_profile_size(ctx);
+	BP_pc_stats *rec = (BP_pc_stats *)malloc((num + 1) * sizeof(BP_pc_stats));
+	if (!rec) {
+		fprintf(stderr, "out of memory\n");
+		exit(10);
+	}
+	num = BP_ctx_profile_top(ctx, rec, num);
+
+	if (top > 0) {
+		printf("top %zu of %zu branches by flushes:\n", top < num ? top : num, num);
+	}
+	for (size_t i = 0; i < top && i < num; ++i) {
+		unsigned flushes = rec[i].dirMisses + rec[i].targetMisses;
+		printf("0x%x: br_num: %u, flush_num: %u (direction: %u, target: %u), allocations: %u, flush rate: %.2f%%\n",
+				rec[i].pc, rec[i].executions, flushes, rec[i].dirMisses, rec[i].targetMisses,
+				rec[i].allocations, 100.0 * flushes / rec[i].executions);
+	}
+
+	if (dumpFile) {
+		FILE *dump = fopen(dumpFile, "w");
+		if (dump == 0) {
+			fprintf(stderr, "cannot open profile dump file\n");
+			exit(2);
+		}
+		fprintf(dump, "pc,executions,flushes,direction_misses,target_misses,allocations\n");
+		for (size_t i = 0; i < num; ++i) {
+			fprintf(dump, "0x%x,%u,%u,%u,%u,%u\n", rec[i].pc, rec[i].executions,
+					rec[i].dirMisses + rec[i].targetMisses, rec[i].dirMisses, rec[i].targetMisses,
+					rec[i].allocations);
+		}
+		if (fclose(dump) != 0) {
+			fprintf(stderr, "cannot write profile dump file\n");
+			exit(11);
+		}
+	}
+	free(rec);
+}
+
+/* Run the trace through the BP_* API, printing every prediction */
+static void run_verbose(trace_input *in, const BP_config *cfg, SIM_stats *stats, interval_stats *iv) {
+	if (BP_init(cfg->btbSize, cfg->historySize, cfg->tagSize, cfg->fsmState, cfg->isGlobalHist,
+			cfg->isGlobalTable, cfg->Shared) < 0) {
 		fprintf(stderr, "Predictor init failed\n");
 		exit(8);
 	}
 
-	while ((fgets(line, 256, trace) != NULL)) {
-		if (line[0] == '\n') {
-			break;
+	const BP_branch *batch;
+	size_t num;
+	SIM_stats now;
+	while ((num = next_batch(in, &batch)) > 0) {
+		for (size_t i = 0; i < num; ++i) {
+			const BP_branch *br = &batch[i];
+			uint32_t dst = 0;
+			printf("0x%x ", br->pc);
+			printf("%c ", (BP_predict(br->pc, &dst)? 'T' : 'N'));
+			printf("0x%x\n", dst);
+
+			BP_update(br->pc, br->targetPc, br->taken, dst);
+			if (iv->every && ++iv->pending == iv->every) {
+				BP_GetStatsSnapshot(&now);
+				interval_report(iv, &now);
+			}
 		}
-		char *elemnts[3];
-		int i = 0;
-		elemnts[0] = strtok(line, " ");
-		for (i = 1; i < 3; ++i) {
-			elemnts[i] = strtok(NULL, " \n");
+	}
+	if (iv->pending) {
+		BP_GetStatsSnapshot(&now);
+		interval_report(iv, &now);
+	}
+
+	BP_GetStats(stats);
+}
+
+/* Run the trace in batches through a context, optionally printing every prediction */
+static void run_ctx(trace_input *in, BP_ctx *ctx, bool verbose, interval_stats *iv) {
+	static BP_prediction pred[BATCH_SIZE];
+	const BP_branch *batch;
+	size_t num;
+	SIM_stats now;
+	while ((num = next_batch(in, &batch)) > 0) {
+		// Split the batch at interval ends
+		for (size_t done = 0, part; done < num; done += part) {
+			part = interval_room(iv, num - done);
+			BP_ctx_run(ctx, batch + done, part, verbose ? pred : NULL);
+			for (size_t i = 0; verbose && i < part; ++i) {
+				printf("0x%x %c 0x%x\n", batch[done + i].pc, pred[i].taken ? 'T' : 'N', pred[i].dst);
+			}
+			iv->pending += part;
+			if (iv->every && iv->pending == iv->every) {
+				BP_ctx_stats(ctx, &now);
+				interval_report(iv, &now);
+			}
 		}
-		uint32_t pc = (uint32_t) strtol(elemnts[0], NULL, 0);
-		uint32_t targetPc = (uint32_t) strtol(elemnts[2], NULL, 0);
-		bool taken;
-		if (strcmp(elemnts[1], "T") == 0) {
-			taken = true;
-		} else if (strcmp(elemnts[1], "N") == 0) {
-			taken = false;
+	}
+	if (iv->pending && iv->every) {
+		BP_ctx_stats(ctx, &now);
+		interval_report(iv, &now);
+	}
+}
+
+int main(int argc, char **argv) {
+
+	static char outputBuffer[OUTPUT_BUFFER_SIZE];
+	setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+
+	const char *configList = NULL;
+	const char *traceFile = NULL;
+	long threads = 0;
+	bool footprint = false;
+	bool quiet = false;
+	bool lockstep = true;
+	const char *engineSpec = NULL;
+	interval_stats iv;
+	memset(&iv, 0, sizeof(iv));
+	size_t profileTop = 0;
+	const char *profileDump = NULL;
+	const char *checkpointIn = NULL;
+	const char *checkpointOut = NULL;
+	sample_plan sample = { 0, 0, 0, false };
+	for (int a = 1; a < argc; ++a) {
+		if (strcmp(argv[a], "--sweep") == 0 && a + 1 < argc) {
+			configList = argv[++a];
+		} else if (strcmp(argv[a], "--threads") == 0 && a + 1 < argc) {
+			threads = strtol(argv[++a], NULL, 0);
+		} else if (strcmp(argv[a], "--footprint") == 0) {
+			footprint = true;
+		} else if (strcmp(argv[a], "--quiet") == 0) {
+			quiet = true;
+		} else if (strcmp(argv[a], "--engine") == 0 && a + 1 < argc) {
+			engineSpec = argv[++a];
+		} else if (strcmp(argv[a], "--profile") == 0 && a + 1 < argc) {
+			profileTop = strtoul(argv[++a], NULL, 0);
+		} else if (strcmp(argv[a], "--profile-dump") == 0 && a + 1 < argc) {
+			profileDump = argv[++a];
+		} else if (strcmp(argv[a], "--checkpoint-in") == 0 && a + 1 < argc) {
+			checkpointIn = argv[++a];
+		} else if (strcmp(argv[a], "--checkpoint-out") == 0 && a + 1 < argc) {
+			checkpointOut = argv[++a];
+		} else if (strcmp(argv[a], "--sample") == 0 && a + 1 < argc) {
+			if (sscanf(argv[++a], "%lu,%lu,%lu", &sample.period, &sample.warmup, &sample.detail) != 3
+					|| sample.detail == 0 || sample.warmup + sample.detail > sample.period) {
+				fprintf(stderr, "Error in arguments: bad sample plan\n");
+				exit(1);
+			}
+		} else if (strcmp(argv[a], "--sample-skip") == 0) {
+			sample.skip = true;
+		} else if (strcmp(argv[a], "--interval") == 0 && a + 1 < argc) {
+			iv.every = strtoul(argv[++a], NULL, 0);
+		} else if (strcmp(argv[a], "--no-lockstep") == 0) {
+			lockstep = false;
 		} else {
-			fprintf(stderr, "Error in input file: bad trace\n");
-			exit(9);
+			traceFile = argv[a];
 		}
-		uint32_t dst = 0;
-		printf("0x%x ", pc);
-		printf("%c ", (BP_predict(pc, &dst)? 'T' : 'N'));
-		printf("0x%x\n", dst);
+	}
 
+	if (traceFile == NULL) {
+		fprintf(stderr, "Usage: %s [--quiet] [--footprint] [--interval N] [--profile N] [--profile-dump <file>] [--checkpoint-in <file>] [--checkpoint-out <file>] [--sample P,W,D [--sample-skip]] [--engine <spec>] [--sweep <config list> [--threads N] [--no-lockstep]] <trace filename | ->\n", argv[0]);
+		exit(1);
+	}
 
-		BP_update(pc, targetPc, taken, dst);
+	if (sample.period && iv.every) {
+		// A sampled run measures only parts of the trace, so it has no per-interval flushes
+		fprintf(stderr, "Error in arguments: --interval cannot be used with --sample\n");
+		exit(1);
+	}
+
+	trace_input in;
+	open_input(traceFile, &in, configList ? SWEEP_BATCH_SIZE : BATCH_SIZE);
+
+	if (configList != NULL) {
+		// The trace's own config line is ignored in sweep mode
+		int ret = run_sweep(&in, configList, threads, footprint, lockstep);
+		close_input(&in);
+		return ret;
 	}
 
 	SIM_stats stats;
-	BP_GetStats(&stats);
+	size_t bytes = 0;
+	bool profile = profileTop > 0 || profileDump != NULL;
+	bool ctxOnly = profile || checkpointIn || checkpointOut || sample.period; // Features of BP_ctx only
+	BP_ctx *ctx = NULL;
+	if (engineSpec != NULL) {
+		// The trace's own config line is ignored when running an engine
+		BP_engine_config ecfg;
+		if (BP_parse_engine(engineSpec, &ecfg) < 0) {
+			fprintf(stderr, "Error in arguments: bad engine\n");
+			exit(1);
+		}
+		ctx = BP_create_engine(&ecfg);
+		if (!ctx) {
+			fprintf(stderr, "Predictor init failed\n");
+			exit(8);
+		}
+	} else {
+		BP_config cfg;
+		int err = BP_parse_config(in.config, &cfg);
+		if (err) {
+			fprintf(stderr, "Error in input file: cannot read config\n");
+			exit(err);
+		}
+		ctx = BP_create(&cfg);
+		if (!ctx) {
+			fprintf(stderr, "Predictor init failed\n");
+			exit(8);
+		}
+		bytes = BP_ctx_footprint(ctx);
+		bool legacy = cfg.btbSize <= 32 && cfg.btbWays <= 1 && !cfg.btbHash;
+		if (legacy && !quiet && !ctxOnly) {
+			// The BP_* API runs its own predictor
+			BP_destroy(ctx);
+			ctx = NULL;
+			run_verbose(&in, &cfg, &stats, &iv);
+		}
+	}
+	if (ctx) {
+		if (profile && BP_ctx_profile(ctx, 0) < 0) {
+			fprintf(stderr, "out of memory\n");
+			exit(10);
+		}
+		if (checkpointIn) {
+			// Warm start: the predictor state is restored, the stats start from zero
+			read_checkpoint(ctx, checkpointIn);
+			BP_ctx_reset_stats(ctx);
+		}
+		if (sample.period) {
+			run_sampled(&in, ctx, &sample, &stats);
+		} else {
+			run_ctx(&in, ctx, !quiet, &iv);
+			BP_ctx_stats(ctx, &stats);
+		}
+		bytes = BP_ctx_footprint(ctx);
+		if (checkpointOut) {
+			write_checkpoint(ctx, checkpointOut);
+		}
+	}
+	close_input(&in);
 	printf("flush_num: %d, br_num: %d, size: %db\n", stats.flush_num, stats.br_num, stats.size);
 
+	if (footprint) {
+		printf("footprint: %zuB (%zub allocated for %db of predictor state)\n", bytes, 8 * bytes, stats.size);
+	}
+	if (profile) {
+		report_profile(ctx, profileTop, profileDump);
+	}
+	BP_destroy(ctx);
+
 	return 0;
 }
-
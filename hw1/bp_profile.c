@@ -0,0 +1,180 @@
+/* 046267 Computer Architecture - HW #1 */
+/* Per-PC profiling of a predictor context */
+
+#include "bp_api.h"
+#include "bp_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Profiling wraps the context's update and run kernels: the wrapper probes
+// the BTB, runs the predictor's own update, then counts the branch in an
+// open-addressing hash table keyed by pc. Contexts that never start
+// profiling keep their kernels, so the unprofiled hot path is unchanged.
+
+#define PROFILE_MIN_SLOTS 1024    // Smallest hash table
+#define PROFILE_HASH 0x9E3779B97F4A7C15ull  // Multiplicative hash constant (2^64 / golden ratio)
+
+struct BP_profile {
+    BP_kernel inner;          // Kernels of the profiled predictor
+    BP_pc_stats *slots;       // Linear probing table, a slot with 0 executions is empty
+    size_t mask;              // Number of slots - 1 (a power of 2)
+    unsigned shift;           // 64 - log2(number of slots)
+    size_t count;             // Occupied slots
+};
+
+static inline size_t profile_hash(const BP_profile *p, uint32_t pc) {
+    return (size_t)((pc * PROFILE_HASH) >> p->shift);
+}
+
+// Allocate an empty table of the given size (a power of 2)
+static int profile_alloc(BP_profile *p, size_t slots) {
+    BP_pc_stats *table = (BP_pc_stats *)calloc(slots, sizeof(BP_pc_stats));
+    if (!table) return -1;
+    unsigned bits = 0;
+    while (((size_t)1 << bits) < slots) bits++;
+    p->slots = table;
+    p->mask = slots - 1;
+    p->shift = 64 - bits;
+    p->count = 0;
+    return 0;
+}
+
+// Double the table, keeping every record
+static int profile_grow(BP_profile *p) {
+    BP_pc_stats *old = p->slots;
+    size_t oldSlots = p->mask + 1, count = p->count;
+    if (profile_alloc(p, 2 * oldSlots) < 0) return -1;
+    for (size_t i = 0; i < oldSlots; ++i) {
+        if (!old[i].executions) continue;
+        size_t s = profile_hash(p, old[i].pc);
+        while (p->slots[s].executions) s = (s + 1) & p->mask;
+        p->slots[s] = old[i];
+    }
+    p->count = count;
+    free(old);
+    return 0;
+}
+
+// Find the record of pc, inserting it when new; NULL only when the table is full and cannot grow
+static BP_pc_stats *profile_find(BP_profile *p, uint32_t pc) {
+    size_t s = profile_hash(p, pc);
+    while (p->slots[s].executions) {
+        if (p->slots[s].pc == pc) return &p->slots[s];
+        s = (s + 1) & p->mask;
+    }
+    // Keep the load at most 1/2; if growing fails, keep filling the current table
+    if (2 * (p->count + 1) > p->mask + 1 && profile_grow(p) == 0) {
+        s = profile_hash(p, pc);
+        while (p->slots[s].executions) s = (s + 1) & p->mask;
+    } else if (p->count == p->mask) {
+        return NULL;
+    }
+    p->count++;
+    p->slots[s].pc = pc;
+    return &p->slots[s];
+}
+
+static void profile_update(BP *bp, uint32_t pc, uint32_t targetPc, bool taken, uint32_t pred_dst) {
+    BP_profile *p = bp->profile;
+    bool hit = p->inner.probe(bp, pc);
+    p->inner.update(bp, pc, targetPc, taken, pred_dst);
+
+    BP_pc_stats *rec = profile_find(p, pc);
+    if (!rec) return;
+    // A flush that predicted pc + 4, or a flush of a not taken branch, is a wrong direction
+    bool flush = pred_dst != (taken ? targetPc : pc + 4);
+    bool wrongTarget = flush && taken && pred_dst != pc + 4;
+    rec->executions++;
+    rec->dirMisses += flush && !wrongTarget;
+    rec->targetMisses += wrongTarget;
+    rec->allocations += !hit;
+}
+
+static void profile_run(BP *bp, const BP_branch *br, size_t num, BP_prediction *pred) {
+    BP_predict_fn predict = bp->profile->inner.predict;
+    for (size_t i = 0; i < num; ++i) {
+        uint32_t dst;
+        bool taken = predict(bp, br[i].pc, &dst);
+        if (pred) {
+            pred[i].dst = dst;
+            pred[i].taken = taken;
+        }
+        profile_update(bp, br[i].pc, br[i].targetPc, br[i].taken, dst);
+    }
+}
+
+void bp_set_kernel(BP *bp, const BP_kernel *kernel) {
+    if (!bp->profile) {
+        bp->kernel = *kernel;
+        return;
+    }
+    bp->profile->inner = *kernel;
+    bp->kernel.predict = kernel->predict;
+    bp->kernel.probe = kernel->probe;
+}
+
+void bp_profile_free(BP_profile *profile) {
+    if (!profile) return;
+    free(profile->slots);
+    free(profile);
+}
+
+// Function to start (or restart) per-PC profiling
+int BP_ctx_profile(BP_ctx *bp, size_t staticBranches) {
+    if (!bp) return -1;
+    size_t slots = PROFILE_MIN_SLOTS;
+    while (slots / 2 < staticBranches && slots < ((size_t)1 << 28)) slots *= 2;
+
+    if (bp->profile) {
+        BP_profile *p = bp->profile;
+        BP_pc_stats *old = p->slots;
+        if (profile_alloc(p, slots) < 0) {
+            p->slots = old;
+            return -1;
+        }
+        free(old);
+        return 0;
+    }
+
+    BP_profile *p = (BP_profile *)malloc(sizeof(BP_profile));
+    if (!p || profile_alloc(p, slots) < 0) {
+        free(p);
+        return -1;
+    }
+    p->inner = bp->kernel;
+    bp->profile = p;
+    bp->kernel.update = profile_update;
+    bp->kernel.run = profile_run;
+    return 0;
+}
+
+// Function to get the number of distinct branches profiled
+size_t BP_ctx_profile_size(const BP_ctx *bp) {
+    return bp && bp->profile ? bp->profile->count : 0;
+}
+
+static int compare_flushes(const void *a, const void *b) {
+    const BP_pc_stats *x = (const BP_pc_stats *)a, *y = (const BP_pc_stats *)b;
+    uint64_t fx = (uint64_t)x->dirMisses + x->targetMisses;
+    uint64_t fy = (uint64_t)y->dirMisses + y->targetMisses;
+    if (fx != fy) return fx > fy ? -1 : 1;
+    if (x->executions != y->executions) return x->executions > y->executions ? -1 : 1;
+    return x->pc < y->pc ? -1 : x->pc > y->pc;
+}
+
+// Function to get the branches with the most flushes
+size_t BP_ctx_profile_top(const BP_ctx *bp, BP_pc_stats *out, size_t num) {
+    if (!bp || !bp->profile || !out) return 0;
+    const BP_profile *p = bp->profile;
+    BP_pc_stats *all = (BP_pc_stats *)malloc((p->count + 1) * sizeof(BP_pc_stats));
+    if (!all) return 0;
+    size_t n = 0;
+    for (size_t i = 0; i <= p->mask; ++i) {
+        if (p->slots[i].executions) all[n++] = p->slots[i];
+    }
+    qsort(all, n, sizeof(BP_pc_stats), compare_flushes);
+    if (num > n) num = n;
+    memcpy(out, all, num * sizeof(BP_pc_stats));
+    free(all);
+    return num;
+}
@@ -0,0 +1,267 @@
+/* 046267 Computer Architecture - HW #1 */
+/* Trace parsing helpers for the predictor simulator */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bp_trace.h"
+
+int BP_parse_config(char *line, BP_config *cfg) {
+	char *save = NULL;
+	char *elemnts[7];
+	elemnts[0] = strtok_r(line, " ", &save);
+	for (int i = 1; i < 7; ++i) {
+		elemnts[i] = strtok_r(NULL, " \n", &save);
+	}
+	for (int i = 0; i < 7; ++i) {
+		if (elemnts[i] == NULL) return 4;
+	}
+
+	cfg->btbSize = strtoul(elemnts[0], NULL, 0);
+	cfg->historySize = strtoul(elemnts[1], NULL, 0);
+	cfg->tagSize = strtoul(elemnts[2], NULL, 0);
+	cfg->fsmState = strtoul(elemnts[3], NULL, 0);
+	if (cfg->btbSize == 0 || cfg->historySize == 0) return 4;
+
+	if (strcmp(elemnts[4], "local_history") == 0) {
+		cfg->isGlobalHist = false;
+	} else if (strcmp(elemnts[4], "global_history") == 0) {
+		cfg->isGlobalHist = true;
+	} else {
+		return 5;
+	}
+
+	if (strcmp(elemnts[5], "local_tables") == 0) {
+		cfg->isGlobalTable = false;
+	} else if (strcmp(elemnts[5], "global_tables") == 0) {
+		cfg->isGlobalTable = true;
+	} else {
+		return 6;
+	}
+
+	if (strcmp(elemnts[6], "using_share_lsb") == 0) {
+		cfg->Shared = 1;
+	} else if (strcmp(elemnts[6], "using_share_mid") == 0) {
+		cfg->Shared = 2;
+	} else if (strcmp(elemnts[6], "not_using_share") == 0) {
+		cfg->Shared = 0;
+	} else {
+		return 7;
+	}
+
+	// Optional BTB organization: ways=N, lru or plru, hash
+	cfg->btbWays = 1;
+	cfg->btbRepl = BP_BTB_LRU;
+	cfg->btbHash = false;
+	char *opt;
+	while ((opt = strtok_r(NULL, " \n", &save)) != NULL) {
+		if (strncmp(opt, "ways=", 5) == 0) {
+			char *end;
+			cfg->btbWays = strtoul(opt + 5, &end, 0);
+			if (*end != '\0' || cfg->btbWays == 0) return 4;
+		} else if (strcmp(opt, "lru") == 0) {
+			cfg->btbRepl = BP_BTB_LRU;
+		} else if (strcmp(opt, "plru") == 0) {
+			cfg->btbRepl = BP_BTB_PLRU;
+		} else if (strcmp(opt, "hash") == 0) {
+			cfg->btbHash = true;
+		} else {
+			return 4;
+		}
+	}
+	return 0;
+}
+
+int BP_parse_engine(const char *spec, BP_engine_config *cfg) {
+	// Defaults keep each engine's state in the tens of KB
+	static const struct {
+		const char *name;
+		BP_engine_config cfg;
+	} engines[] = {
+		{ "gshare",     { BP_ENGINE_GSHARE,     10, 16, 16, 16 } },
+		{ "perceptron", { BP_ENGINE_PERCEPTRON, 10, 16, 12, 48 } },
+		{ "tage",       { BP_ENGINE_TAGE,       10, 16, 13, 200 } },
+	};
+
+	size_t nameLen = strcspn(spec, ":");
+	size_t e = 0;
+	for (; e < sizeof(engines) / sizeof(engines[0]); ++e) {
+		if (strlen(engines[e].name) == nameLen && strncmp(spec, engines[e].name, nameLen) == 0) break;
+	}
+	if (e == sizeof(engines) / sizeof(engines[0])) return -1;
+	*cfg = engines[e].cfg;
+
+	const char *p = spec + nameLen;
+	while (*p == ':' || *p == ',') {
+		++p;
+		size_t keyLen = strcspn(p, "=");
+		if (p[keyLen] != '=') return -1;
+		char *end;
+		unsigned long value = strtoul(p + keyLen + 1, &end, 0);
+		if (end == p + keyLen + 1) return -1;
+		if (keyLen == 3 && strncmp(p, "btb", 3) == 0) {
+			cfg->btbBits = value;
+		} else if (keyLen == 3 && strncmp(p, "tag", 3) == 0) {
+			cfg->tagSize = value;
+		} else if (keyLen == 5 && strncmp(p, "table", 5) == 0) {
+			cfg->tableBits = value;
+		} else if (keyLen == 4 && strncmp(p, "hist", 4) == 0) {
+			cfg->historySize = value;
+		} else {
+			return -1;
+		}
+		p = end;
+	}
+	return *p == '\0' ? 0 : -1;
+}
+
+int BP_parse_branch(char *line, BP_branch *br) {
+	char *save = NULL;
+	char *elemnts[3];
+	elemnts[0] = strtok_r(line, " ", &save);
+	for (int i = 1; i < 3; ++i) {
+		elemnts[i] = strtok_r(NULL, " \n", &save);
+	}
+	if (elemnts[0] == NULL || elemnts[1] == NULL || elemnts[2] == NULL) return -1;
+
+	br->pc = (uint32_t) strtol(elemnts[0], NULL, 0);
+	br->targetPc = (uint32_t) strtol(elemnts[2], NULL, 0);
+	if (strcmp(elemnts[1], "T") == 0) {
+		br->taken = 1;
+	} else if (strcmp(elemnts[1], "N") == 0) {
+		br->taken = 0;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+long BP_trace_read(FILE *file, BP_branch *br, size_t max) {
+	char line[1024];
+	size_t num = 0;
+	while (num < max && fgets(line, sizeof(line), file) != NULL) {
+		if (line[0] == '\n') {
+			break;
+		}
+		// A line that does not fit the buffer is malformed, not two branches
+		if (strchr(line, '\n') == NULL && !feof(file)) return -1;
+		if (BP_parse_branch(line, &br[num]) < 0) return -1;
+		num++;
+	}
+	return (long)num;
+}
+
+int BP_bin_open(const char *filename, BP_bin_trace *trace) {
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return -1;
+
+	struct stat st;
+	BP_bin_header header;
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size < sizeof(header)
+			|| read(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)
+			|| memcmp(header.magic, BP_BIN_MAGIC, 4) != 0) {
+		close(fd);
+		return 1;
+	}
+	size_t configSpace = (header.configLen + 3) & ~(size_t)3;
+	size_t offset = sizeof(header) + configSpace;
+	if (header.numBranches == BP_BIN_UNTIL_EOF && (size_t)st.st_size >= offset) {
+		header.numBranches = ((size_t)st.st_size - offset) / sizeof(BP_branch);
+	}
+	// Divide rather than multiply: a forged count must not wrap the size check
+	if (header.version != BP_BIN_VERSION || header.recordSize != sizeof(BP_branch)
+			|| header.configLen >= sizeof(trace->config)
+			|| (size_t)st.st_size < offset
+			|| header.numBranches > ((size_t)st.st_size - offset) / sizeof(BP_branch)) {
+		close(fd);
+		return -1;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return -1;
+	posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+	trace->map = map;
+	trace->mapSize = st.st_size;
+	memcpy(trace->config, (const char *)map + sizeof(header), header.configLen);
+	trace->config[header.configLen] = '\0';
+	trace->br = (const BP_branch *)((const char *)map + offset);
+	trace->num = header.numBranches;
+	return 0;
+}
+
+void BP_bin_close(BP_bin_trace *trace) {
+	if (trace->map) munmap(trace->map, trace->mapSize);
+	trace->map = NULL;
+	trace->br = NULL;
+	trace->num = 0;
+}
+
+int BP_stream_open(FILE *file, BP_stream *stream) {
+	memset(stream, 0, sizeof(*stream));
+	stream->file = file;
+
+	// Tell binary from text by the magic; a text trace gets its first bytes back
+	BP_bin_header header;
+	size_t got = fread(&header, 1, 4, file);
+	if (got < 4 || memcmp(header.magic, BP_BIN_MAGIC, 4) != 0) {
+		if (got == 0) return 3;
+		memcpy(stream->config, header.magic, got);
+		// A config line cut short by EOF is left for BP_parse_config to reject
+		if (memchr(stream->config, '\n', got) == NULL) {
+			char *rest = fgets(stream->config + got, sizeof(stream->config) - got, file);
+			(void)rest;
+		}
+		return 0;
+	}
+
+	char padding[4];
+	if (fread((char *)&header + 4, sizeof(header) - 4, 1, file) != 1
+			|| header.version != BP_BIN_VERSION || header.recordSize != sizeof(BP_branch)
+			|| header.configLen >= sizeof(stream->config)
+			|| fread(stream->config, 1, header.configLen, file) != header.configLen) {
+		return 9;
+	}
+	size_t pad = ((header.configLen + 3) & ~3u) - header.configLen;
+	if (fread(padding, 1, pad, file) != pad) return 9;
+	stream->config[header.configLen] = '\0';
+	stream->binary = true;
+	stream->remaining = header.numBranches;
+	return 0;
+}
+
+long BP_stream_read(BP_stream *stream, BP_branch *br, size_t max) {
+	if (!stream->binary) {
+		return BP_trace_read(stream->file, br, max);
+	}
+	if (stream->remaining < max) max = stream->remaining;
+	size_t num = fread(br, sizeof(BP_branch), max, stream->file);
+	if (num < max && stream->remaining != BP_BIN_UNTIL_EOF) return -1;
+	if (stream->remaining != BP_BIN_UNTIL_EOF) stream->remaining -= num;
+	return (long)num;
+}
+
+int BP_bin_write_header(FILE *file, const char *config, uint64_t numBranches) {
+	BP_bin_header header;
+	memcpy(header.magic, BP_BIN_MAGIC, 4);
+	header.version = BP_BIN_VERSION;
+	header.configLen = strcspn(config, "\n");
+	header.recordSize = sizeof(BP_branch);
+	header.numBranches = numBranches;
+
+	static const char padding[4] = { 0 };
+	size_t pad = ((header.configLen + 3) & ~3u) - header.configLen;
+	if (fwrite(&header, sizeof(header), 1, file) != 1
+			|| fwrite(config, 1, header.configLen, file) != header.configLen
+			|| fwrite(padding, 1, pad, file) != pad) {
+		return -1;
+	}
+	return 0;
+}
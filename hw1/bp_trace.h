@@ -0,0 +1,112 @@
+/* 046267 Computer Architecture - HW #1 */
+/* Trace parsing helpers for the predictor simulator */
+
+#ifndef BP_TRACE_H_
+#define BP_TRACE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "bp_api.h"
+
+/*
+ * Binary trace format (native byte order, all fields 4-byte aligned):
+ *   BP_bin_header
+ *   config line text, configLen bytes, zero padded to a multiple of 4
+ *   numBranches BP_branch records (fixed width, 12 bytes each)
+ * The records have the in-memory layout of BP_branch, so a mapped trace is
+ * handed to BP_ctx_run without copying.
+ * A trace written to a pipe cannot have its count patched in; it carries
+ * BP_BIN_UNTIL_EOF instead, and its records run to the end of the stream.
+ */
+#define BP_BIN_MAGIC "BPTR"
+#define BP_BIN_VERSION 1
+#define BP_BIN_UNTIL_EOF UINT64_MAX
+
+typedef struct {
+	char magic[4];                // BP_BIN_MAGIC
+	uint32_t version;             // BP_BIN_VERSION
+	uint32_t configLen;           // Length of the config line text (no newline)
+	uint32_t recordSize;          // sizeof(BP_branch)
+	uint64_t numBranches;         // Number of branch records
+} BP_bin_header;
+
+/* A memory-mapped binary trace */
+typedef struct {
+	void *map;                    // Mapping of the whole file
+	size_t mapSize;
+	char config[256];             // Config line, NUL terminated
+	const BP_branch *br;          // Records, pointing into the mapping
+	size_t num;
+} BP_bin_trace;
+
+/*
+ * BP_bin_open - map a binary trace
+ * return 0 on success, 1 when the file is not a binary trace, <0 on errors
+ */
+int BP_bin_open(const char *filename, BP_bin_trace *trace);
+
+/*
+ * BP_bin_close - unmap a binary trace opened by BP_bin_open
+ */
+void BP_bin_close(BP_bin_trace *trace);
+
+/* A trace read sequentially from a stream (pipe, FIFO, stdin), text or binary */
+typedef struct {
+	FILE *file;
+	bool binary;                  // Binary records follow the header, else text lines
+	uint64_t remaining;           // Binary records left (BP_BIN_UNTIL_EOF: up to EOF)
+	char config[256];             // Config line, NUL terminated (no newline for binary)
+} BP_stream;
+
+/*
+ * BP_stream_open - read the config line (text) or header (binary) of a stream
+ * Only the first 4 bytes are looked at to tell the formats apart, so the
+ * stream need not be seekable. Memory use does not depend on the trace length.
+ * return 0 on success, otherwise the bp_main exit code (3 no config, 9 bad header)
+ */
+int BP_stream_open(FILE *file, BP_stream *stream);
+
+/*
+ * BP_stream_read - read up to max branch records into br
+ * return the number of records read (< max once the trace ended), <0 on a
+ * malformed text line or a truncated binary trace
+ */
+long BP_stream_read(BP_stream *stream, BP_branch *br, size_t max);
+
+/*
+ * BP_bin_write_header - write the header and config line of a binary trace
+ * (records follow as raw BP_branch structures)
+ * return 0 on success, <0 on write errors
+ */
+int BP_bin_write_header(FILE *file, const char *config, uint64_t numBranches);
+
+/*
+ * BP_parse_config - parse a trace config line into cfg (line is modified)
+ * the 7 standard fields may be followed by BTB options: "ways=N" (associativity),
+ * "lru" or "plru" (replacement policy) and "hash" (XOR-hashed set index)
+ * return 0 on success, otherwise the bp_main exit code of the failing field (4..7)
+ */
+int BP_parse_config(char *line, BP_config *cfg);
+
+/*
+ * BP_parse_engine - parse an engine spec "<gshare|perceptron|tage>[:key=N,...]"
+ * keys: btb (log2 target buffer entries), tag, table (log2 entries), hist
+ * keys left out get the engine's default sizes
+ * return 0 on success, <0 on a malformed spec
+ */
+int BP_parse_engine(const char *spec, BP_engine_config *cfg);
+
+/*
+ * BP_parse_branch - parse a "<pc> <T|N> <target>" trace line (line is modified)
+ * return 0 on success, <0 on a malformed line
+ */
+int BP_parse_branch(char *line, BP_branch *br);
+
+/*
+ * BP_trace_read - read up to max branch lines into br, stopping at EOF or an empty line
+ * return the number of records read (< max once the trace ended), <0 on a malformed line
+ */
+long BP_trace_read(FILE *file, BP_branch *br, size_t max);
+
+#endif /* BP_TRACE_H_ */
@@ -0,0 +1,77 @@
+/* 046267 Computer Architecture - HW #1 */
+/* Convert a text branch trace to the binary (mmap-able) trace format */
+/* Usage: ./bp_trconv <text trace> <binary trace>                     */
+/* Either name may be - for stdin/stdout; a trace written to a pipe     */
+/* has no record count in its header and runs up to the end of stream   */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bp_api.h"
+#include "bp_trace.h"
+
+#define BATCH_SIZE 65536
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s <text trace> <binary trace>\n", argv[0]);
+		exit(1);
+	}
+
+	FILE *in = strcmp(argv[1], "-") == 0 ? stdin : fopen(argv[1], "r");
+	if (in == 0) {
+		fprintf(stderr, "cannot open trace file\n");
+		exit(2);
+	}
+	FILE *out = strcmp(argv[2], "-") == 0 ? stdout : fopen(argv[2], "wb");
+	if (out == 0) {
+		fprintf(stderr, "cannot open output file\n");
+		exit(2);
+	}
+
+	char line[1024];
+	if (fgets(line, 256, in) == NULL) {
+		fprintf(stderr, "Error in input file: cannot read config\n");
+		exit(3);
+	}
+
+	// The record count is patched into the header once the trace is converted,
+	// unless the output cannot seek
+	bool seekable = fseek(out, 0, SEEK_CUR) == 0;
+	if (BP_bin_write_header(out, line, seekable ? 0 : BP_BIN_UNTIL_EOF) < 0) {
+		fprintf(stderr, "cannot write output file\n");
+		exit(11);
+	}
+
+	BP_branch *batch = (BP_branch *)malloc(BATCH_SIZE * sizeof(BP_branch));
+	if (!batch) {
+		fprintf(stderr, "out of memory\n");
+		exit(10);
+	}
+	uint64_t total = 0;
+	long num;
+	do {
+		num = BP_trace_read(in, batch, BATCH_SIZE);
+		if (num < 0) {
+			fprintf(stderr, "Error in input file: bad trace\n");
+			exit(9);
+		}
+		if (fwrite(batch, sizeof(BP_branch), num, out) != (size_t)num) {
+			fprintf(stderr, "cannot write output file\n");
+			exit(11);
+		}
+		total += num;
+	} while (num == BATCH_SIZE);
+
+	if ((seekable && (fseek(out, 0, SEEK_SET) != 0 || BP_bin_write_header(out, line, total) < 0))
+			|| fclose(out) != 0) {
+		fprintf(stderr, "cannot write output file\n");
+		exit(11);
+	}
+	fclose(in);
+	free(batch);
+	return 0;
+}
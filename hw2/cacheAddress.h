@@ -0,0 +1,20 @@
+#ifndef CACHE_ADDRESS_H
+#define CACHE_ADDRESS_H
+
+// Address decoding shared by the caches and the trace analyses
+
+// Set index of an address in a cache of numSets sets (a power of 2)
+inline unsigned blockIndex(unsigned long int address, unsigned BSizeBits, unsigned numSets) {
+    return (address >> BSizeBits) & (numSets - 1);
+}
+
+// A stored tag carries this bit while its line is valid; tags are address
+// bits above the block offset, so they never reach it themselves
+const unsigned long int VALID_TAG = 1ul << (sizeof(unsigned long int) * 8 - 1);
+
+// Tag of an address in a cache of 2^setBits sets
+inline unsigned long int blockTag(unsigned long int address, unsigned BSizeBits, unsigned setBits) {
+    return address >> (BSizeBits + setBits);
+}
+
+#endif
@@ -0,0 +1,251 @@
+#ifndef CACHE_CONFIG_H
+#define CACHE_CONFIG_H
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Description of a cache hierarchy, read from a config file:
+//
+//   # comment
+//   bsize 6                 log2 of the block size, shared by all levels
+//   mem-cyc 100             memory access time
+//   word-size 4             bytes moved by a write that is not allocated or is written through
+//   level L1I size=15 assoc=2 cyc=1 next=L2
+//   level L1D size=15 assoc=3 cyc=1 wr-alloc=1 write=back
+//   level L2 size=18 assoc=3 cyc=12 inclusion=inclusive prefetch=stride degree=2
+//   level L3 size=22 assoc=4 cyc=40 inclusion=nine
+//   data L1D                first level of data accesses (default: the first level)
+//   instructions L1I        first level of instruction fetches (default: as data)
+//   replacement lru         replacement policy of all levels: lru, plru, srrip,
+//                           brrip, drrip, random or fifo (see replacement.h)
+//
+// Sizes and associativities are log2, as on the command line. A level's next
+// level defaults to the level after it in the file; the last level's next
+// level is memory. The inclusion policy of a level is relative to the levels
+// that miss into it:
+//   inclusive  it holds everything they hold; its evictions back-invalidate them
+//   exclusive  it holds only their victims; a hit moves the block up
+//   nine       neither (non-inclusive non-exclusive)
+// A write-back level (write=back) keeps writes in dirty lines until they are
+// evicted; a write-through level (write=through) also passes every write to
+// its next level. A level may have a prefetcher (prefetch=next-line, stride
+// or best-offset, see prefetcher.h) that brings in degree blocks per trigger.
+// wr-alloc defaults to 1, write to back, inclusion to inclusive, prefetch to
+// none and degree to 1.
+
+enum InclusionPolicy {
+    INCLUSIVE,
+    EXCLUSIVE,
+    NINE
+};
+
+enum PrefetchKind {
+    PREFETCH_NONE,
+    PREFETCH_NEXT_LINE,
+    PREFETCH_STRIDE,
+    PREFETCH_BEST_OFFSET
+};
+
+// Prefetcher kind by name; false for an unknown name
+inline bool parsePrefetchKind(const std::string& name, PrefetchKind& kind) {
+    if (name == "none") {
+        kind = PREFETCH_NONE;
+    } else if (name == "next-line") {
+        kind = PREFETCH_NEXT_LINE;
+    } else if (name == "stride") {
+        kind = PREFETCH_STRIDE;
+    } else if (name == "best-offset") {
+        kind = PREFETCH_BEST_OFFSET;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+enum ReplacementPolicy {
+    REPLACE_LRU,
+    REPLACE_PLRU,
+    REPLACE_SRRIP,
+    REPLACE_BRRIP,
+    REPLACE_DRRIP,
+    REPLACE_RANDOM,
+    REPLACE_FIFO
+};
+
+inline const char* replacementPolicyName(ReplacementPolicy policy) {
+    static const char* names[] = { "lru", "plru", "srrip", "brrip", "drrip", "random", "fifo" };
+    return names[policy];
+}
+
+// Replacement policy by name; false for an unknown name
+inline bool parseReplacementPolicy(const std::string& name, ReplacementPolicy& policy) {
+    for (unsigned i = REPLACE_LRU; i <= REPLACE_FIFO; ++i) {
+        if (name == replacementPolicyName(static_cast<ReplacementPolicy>(i))) {
+            policy = static_cast<ReplacementPolicy>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+struct LevelConfig {
+    std::string name;
+    unsigned SizeBits = 0;   // Cache size in bits
+    unsigned AssocBits = 0;  // Associativity in bits
+    unsigned Cyc = 0;        // Access time
+    unsigned WrAlloc = 1;    // Write allocate policy
+    unsigned WrBack = 1;     // Write-back (1) or write-through (0)
+    InclusionPolicy inclusion = INCLUSIVE;
+    PrefetchKind prefetch = PREFETCH_NONE;
+    unsigned prefetchDegree = 1;  // Blocks prefetched per trigger
+    std::string next;        // Name of the next level, empty for the default
+};
+
+struct HierarchyConfig {
+    unsigned BSizeBits = 0;  // Block size in bits
+    unsigned MemCyc = 0;     // Memory access time
+    unsigned WordSize = 4;   // Bytes of a write passed on without its block
+    ReplacementPolicy replacement = REPLACE_LRU;
+    std::vector<LevelConfig> levels;
+    std::string data;          // First level of data accesses, empty for the first level
+    std::string instructions;  // First level of instruction fetches, empty for data's
+
+    // Index of a level by name, or -1
+    int find(const std::string& name) const {
+        for (size_t i = 0; i < levels.size(); ++i) {
+            if (levels[i].name == name) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    // Index of the level a level misses into, or -1 for memory
+    int nextOf(size_t i) const {
+        if (!levels[i].next.empty()) return find(levels[i].next);
+        return i + 1 < levels.size() ? static_cast<int>(i + 1) : -1;
+    }
+
+    // The classic hierarchy of the command line: L1 backed by an inclusive L2
+    static HierarchyConfig twoLevel(unsigned MemCyc, unsigned BSize, unsigned L1Size, unsigned L1Assoc, unsigned L1Cyc,
+                                    unsigned L2Size, unsigned L2Assoc, unsigned L2Cyc, unsigned WrAlloc) {
+        HierarchyConfig config;
+        config.BSizeBits = BSize;
+        config.MemCyc = MemCyc;
+        LevelConfig l1;
+        l1.name = "L1";
+        l1.SizeBits = L1Size;
+        l1.AssocBits = L1Assoc;
+        l1.Cyc = L1Cyc;
+        l1.WrAlloc = WrAlloc;
+        LevelConfig l2 = l1;
+        l2.name = "L2";
+        l2.SizeBits = L2Size;
+        l2.AssocBits = L2Assoc;
+        l2.Cyc = L2Cyc;
+        config.levels.push_back(l1);
+        config.levels.push_back(l2);
+        return config;
+    }
+
+    // Check that the levels fit together; returns an error message, empty when valid
+    std::string validate() const {
+        if (levels.empty()) return "no cache levels";
+        for (size_t i = 0; i < levels.size(); ++i) {
+            const LevelConfig& level = levels[i];
+            if (level.SizeBits > 40 || level.SizeBits < BSizeBits + level.AssocBits) {
+                return "level " + level.name + " is smaller than one set";
+            }
+            if (find(level.name) != static_cast<int>(i)) return "level " + level.name + " is defined twice";
+            if (!level.next.empty() && find(level.next) <= static_cast<int>(i)) {
+                return "next level of " + level.name + " must be a later level";
+            }
+        }
+        if (!data.empty() && find(data) < 0) return "unknown data level " + data;
+        if (!instructions.empty() && find(instructions) < 0) return "unknown instruction level " + instructions;
+        for (size_t i = 0; i < levels.size(); ++i) {
+            if (levels[i].inclusion != EXCLUSIVE) continue;
+            bool fed = false;
+            for (size_t j = 0; j < i; ++j) {
+                fed = fed || nextOf(j) == static_cast<int>(i);
+            }
+            if (!fed) return "exclusive level " + levels[i].name + " has no level above it";
+        }
+        return "";
+    }
+
+    // Read a config file; returns an error message, empty on success
+    std::string load(const char* path) {
+        std::ifstream file(path);
+        if (!file) return std::string("cannot open ") + path;
+        std::string line;
+        unsigned lineNumber = 0;
+        while (std::getline(file, line)) {
+            lineNumber++;
+            std::string where = "line " + std::to_string(lineNumber) + ": ";
+            size_t comment = line.find('#');
+            if (comment != std::string::npos) line.erase(comment);
+            std::istringstream words(line);
+            std::string key;
+            if (!(words >> key)) continue;
+
+            if (key == "bsize" || key == "mem-cyc" || key == "word-size") {
+                unsigned value;
+                if (!(words >> value)) return where + "missing value of " + key;
+                (key == "bsize" ? BSizeBits : key == "mem-cyc" ? MemCyc : WordSize) = value;
+            } else if (key == "data" || key == "instructions") {
+                if (!(words >> (key == "data" ? data : instructions))) return where + "missing level of " + key;
+            } else if (key == "replacement") {
+                std::string name;
+                if (!(words >> name)) return where + "missing policy of replacement";
+                if (!parseReplacementPolicy(name, replacement)) return where + "unknown replacement policy " + name;
+            } else if (key == "level") {
+                LevelConfig level;
+                if (!(words >> level.name)) return where + "missing level name";
+                std::string option;
+                while (words >> option) {
+                    size_t eq = option.find('=');
+                    if (eq == std::string::npos) return where + "expected key=value, got " + option;
+                    std::string name = option.substr(0, eq), value = option.substr(eq + 1);
+                    if (name == "size") {
+                        level.SizeBits = atoi(value.c_str());
+                    } else if (name == "assoc") {
+                        level.AssocBits = atoi(value.c_str());
+                    } else if (name == "cyc") {
+                        level.Cyc = atoi(value.c_str());
+                    } else if (name == "wr-alloc") {
+                        level.WrAlloc = atoi(value.c_str());
+                    } else if (name == "write") {
+                        if (value != "back" && value != "through") return where + "unknown write policy " + value;
+                        level.WrBack = value == "back";
+                    } else if (name == "prefetch") {
+                        if (!parsePrefetchKind(value, level.prefetch)) return where + "unknown prefetcher " + value;
+                    } else if (name == "degree") {
+                        level.prefetchDegree = atoi(value.c_str());
+                    } else if (name == "next") {
+                        level.next = value;
+                    } else if (name == "inclusion") {
+                        if (value == "inclusive") {
+                            level.inclusion = INCLUSIVE;
+                        } else if (value == "exclusive") {
+                            level.inclusion = EXCLUSIVE;
+                        } else if (value == "nine") {
+                            level.inclusion = NINE;
+                        } else {
+                            return where + "unknown inclusion policy " + value;
+                        }
+                    } else {
+                        return where + "unknown level option " + name;
+                    }
+                }
+                levels.push_back(level);
+            } else {
+                return where + "unknown key " + key;
+            }
+        }
+        return validate();
+    }
+};
+
+#endif
@@ -1,31 +1,391 @@
 #include <cstdlib>
 #include <iostream>
-#include <fstream>
 #include <sstream>
-#include "cachestruct.cpp"
+#include <vector>
+#include "cacheStruct.cpp"
+#include "multicore.h"
+#include "shardedSim.h"
+#include "stackDistance.h"
+#include "sweep.h"
+#include "traceReader.h"
 
 using std::FILE;
 using std::string;
 using std::cout;
 using std::endl;
 using std::cerr;
-using std::ifstream;
-using std::stringstream;
-
-unsigned long int evictedAddressFromL2 = 0;
-bool evictionFlag = false;
-
-// Function to calculate average access time
-double avgAccTimeCalculator(const L1Cache& l1Cache, const L2Cache& l2Cache, unsigned memCyc) {
-    double L1MissRate = l1Cache.hitMissCalculator();
-    double L2MissRate = l2Cache.hitMissCalculator();
-    double avgAccTime = l1Cache.getAccessTime() + (L1MissRate * (l2Cache.getAccessTime() + (L2MissRate * memCyc)));
-    return avgAccTime;
+
+// Memory traffic: bytes read and written, per 1000 accesses, and per cycle
+// taking every access to last the average access time
+template <class Hierarchy>
+void printTraffic(const Hierarchy& caches) {
+	uint64_t reads = caches.getMemoryReadBytes(), writes = caches.getMemoryWriteBytes();
+	uint64_t writebacks = 0;
+	for (size_t i = 0; i < caches.numLevels(); ++i) {
+		const TrafficStats& traffic = caches.level(i).getTraffic();
+		writebacks += traffic.writebacks + traffic.invalidationWritebacks;
+	}
+	uint64_t accesses = caches.accesses();
+	double cycles = accesses * caches.avgAccessTime();
+	printf("Writebacks=%llu MemRead=%lluB MemWrite=%lluB TrafficPer1k=%.1fB MemBW=%.3fB/cyc\n",
+			static_cast<unsigned long long>(writebacks), static_cast<unsigned long long>(reads),
+			static_cast<unsigned long long>(writes), accesses ? 1000.0 * (reads + writes) / accesses : 0.0,
+			cycles > 0 ? (reads + writes) / cycles : 0.0);
+}
+
+// Prefetcher statistics of every level that has one. Coverage is the share of
+// would-be misses that prefetches turned into hits, accuracy the share of
+// prefetched blocks that were used, timeliness the share of used prefetches
+// that were not late; unused prefetches are extra traffic.
+template <class Hierarchy>
+void printPrefetch(const Hierarchy& caches, unsigned BSize) {
+	for (size_t i = 0; i < caches.numLevels(); ++i) {
+		const Prefetcher& prefetcher = caches.prefetcher(i);
+		if (!prefetcher.enabled()) continue;
+		const PrefetchStats& stats = prefetcher.stats;
+		uint64_t misses = caches.level(i).getMisses();
+		printf("%s prefetch: issued=%llu useful=%llu late=%llu late-cycles=%llu coverage=%.03f accuracy=%.03f "
+				"timeliness=%.03f extra=%lluB\n",
+				caches.level(i).getName().c_str(), static_cast<unsigned long long>(stats.issued),
+				static_cast<unsigned long long>(stats.useful), static_cast<unsigned long long>(stats.late),
+				static_cast<unsigned long long>(stats.lateCycles),
+				stats.useful + misses ? static_cast<double>(stats.useful) / (stats.useful + misses) : 0.0,
+				stats.issued ? static_cast<double>(stats.useful) / stats.issued : 0.0,
+				stats.useful ? static_cast<double>(stats.useful - stats.late) / stats.useful : 0.0,
+				static_cast<unsigned long long>((stats.issued - stats.useful) << BSize));
+	}
+}
+
+// Stack-distance mode: LRU miss rates of all sizes and associativities
+int runStackDistance(TraceReader& trace, unsigned BSize, unsigned maxAssoc, unsigned maxSize) {
+	unsigned maxSetBits = maxSize > BSize ? maxSize - BSize : 0;
+	StackDistance analysis(BSize, maxSetBits, maxAssoc);
+	char operation = 0;
+	unsigned long int num = 0;
+	int status;
+	while ((status = trace.next(operation, num)) > 0) {
+		analysis.access(num);
+	}
+	if (status < 0) {
+		cout << "Command Format error" << endl;
+		return 0;
+	}
+	analysis.analyze();
+
+	// Sizes and associativities are log2, as in --l1-size and --l1-assoc
+	printf("accesses=%zu blocks=%zu bsize=%u\n", analysis.accesses(), analysis.blocks(), BSize);
+	for (unsigned size = BSize; size <= maxSize; ++size) {
+		for (unsigned assoc = 0; assoc <= maxAssoc && BSize + assoc <= size; ++assoc) {
+			unsigned setBits = size - BSize - assoc;
+			if (setBits > maxSetBits) continue;
+			printf("size=%u assoc=%u miss=%.03f\n", size, assoc, analysis.missRate(setBits, assoc));
+		}
+	}
+	return 0;
+}
+
+// Multicore run of the opened traces
+template <class Replacement>
+int simulateMulticore(const HierarchyConfig& config, std::vector<TraceReader>& traces, unsigned threads,
+		unsigned epoch, unsigned numHotLines) {
+	MulticoreSim<Replacement> sim(config, static_cast<unsigned>(traces.size()), epoch ? epoch : 1);
+	char unknown = 0;
+	int status = sim.run(traces, threads, unknown);
+	if (status == -2) {
+		cerr << "Unknown operation: " << unknown << endl;
+		return 0;
+	} else if (status < 0) {
+		cout << "Command Format error" << endl;
+		return 0;
+	}
+
+	// All cores together first, in the classic format, then every core
+	uint64_t hits = 0, misses = 0, accesses = 0;
+	double time = 0;
+	for (size_t c = 0; c < sim.numCores(); ++c) {
+		hits += sim.l1(c).getHits();
+		misses += sim.l1(c).getMisses();
+		accesses += sim.coreStats(c).accesses;
+		time += sim.coreStats(c).accesses * sim.accessTime(c);
+	}
+	printf("L1miss=%.03f ", hits + misses ? static_cast<double>(misses) / (hits + misses) : 0.0);
+	printf("L2miss=%.03f ", sim.sharedL2().hitMissCalculator());
+	printf("AccTimeAvg=%.03f\n", accesses ? time / accesses : 0.0);
+	for (size_t c = 0; c < sim.numCores(); ++c) {
+		const CoreStats& stats = sim.coreStats(c);
+		printf("core %zu: accesses=%llu L1miss=%.03f coherence=%llu false-sharing=%llu upgrades=%llu "
+				"invalidations=%llu back-invalidations=%llu writebacks=%llu AccTimeAvg=%.03f\n",
+				c, static_cast<unsigned long long>(stats.accesses), sim.l1(c).hitMissCalculator(),
+				static_cast<unsigned long long>(stats.coherenceMisses),
+				static_cast<unsigned long long>(stats.falseSharingMisses),
+				static_cast<unsigned long long>(stats.upgrades), static_cast<unsigned long long>(stats.invalidations),
+				static_cast<unsigned long long>(stats.backInvalidations),
+				static_cast<unsigned long long>(stats.writebacks), sim.accessTime(c));
+	}
+	printf("L2: accesses=%llu misses=%llu MemRead=%llu MemWrite=%llu blocks\n",
+			static_cast<unsigned long long>(sim.sharedL2().getHits() + sim.sharedL2().getMisses()),
+			static_cast<unsigned long long>(sim.sharedL2().getMisses()),
+			static_cast<unsigned long long>(sim.getMemoryReads()),
+			static_cast<unsigned long long>(sim.getMemoryWrites()));
+	for (const auto& line : sim.hotLines(numHotLines)) {
+		printf("false sharing 0x%08lx: invalidations=%llu\n", line.first, static_cast<unsigned long long>(line.second));
+	}
+	return 0;
+}
+
+// Multicore mode: the trace of core 0 and the traces of the other cores share the L2 of the config
+int runMulticore(const HierarchyConfig& config, const char* firstTrace, const string& otherTraces, unsigned threads,
+		unsigned epoch, unsigned numHotLines) {
+	// The coherence model has a unified write-back L1 per core in front of an
+	// inclusive write-back L2, and no prefetchers
+	if (config.levels.size() != 2 || config.nextOf(0) != 1 || config.nextOf(1) != -1
+			|| (!config.data.empty() && config.find(config.data) != 0)
+			|| (!config.instructions.empty() && config.find(config.instructions) != 0)) {
+		cerr << "Multicore mode needs two levels" << endl;
+		return 0;
+	}
+	if (config.levels[1].inclusion != INCLUSIVE) {
+		cerr << "Multicore mode needs an inclusive L2" << endl;
+		return 0;
+	}
+	for (const LevelConfig& level : config.levels) {
+		if (!level.WrBack) {
+			cerr << "Multicore mode needs write-back levels" << endl;
+			return 0;
+		}
+		if (level.prefetch != PREFETCH_NONE) {
+			cerr << "Multicore mode has no prefetchers" << endl;
+			return 0;
+		}
+	}
+
+	std::vector<string> paths(1, firstTrace);
+	std::istringstream list(otherTraces);
+	string path;
+	while (std::getline(list, path, ',')) {
+		if (!path.empty()) paths.push_back(path);
+	}
+	if (paths.size() > 64) {
+		cerr << "At most 64 cores" << endl;
+		return 0;
+	}
+	std::vector<TraceReader> traces(paths.size());
+	for (size_t c = 0; c < paths.size(); ++c) {
+		if (!traces[c].open(paths[c].c_str())) {
+			cerr << "File not found" << endl;
+			return 0;
+		}
+	}
+
+	switch (config.replacement) {
+	case REPLACE_PLRU:
+		return simulateMulticore<PlruReplacement>(config, traces, threads, epoch, numHotLines);
+	case REPLACE_SRRIP:
+		return simulateMulticore<RripReplacement<RRIP_STATIC>>(config, traces, threads, epoch, numHotLines);
+	case REPLACE_BRRIP:
+		return simulateMulticore<RripReplacement<RRIP_BIMODAL>>(config, traces, threads, epoch, numHotLines);
+	case REPLACE_DRRIP:
+		return simulateMulticore<RripReplacement<RRIP_DYNAMIC>>(config, traces, threads, epoch, numHotLines);
+	case REPLACE_RANDOM:
+		return simulateMulticore<RandomReplacement>(config, traces, threads, epoch, numHotLines);
+	case REPLACE_FIFO:
+		return simulateMulticore<FifoReplacement>(config, traces, threads, epoch, numHotLines);
+	default:
+		return simulateMulticore<LruReplacement>(config, traces, threads, epoch, numHotLines);
+	}
+}
+
+// Statistics of a finished run
+template <class Hierarchy>
+void printResults(const Hierarchy& caches, const HierarchyConfig& config, bool perLevel, bool showTraffic) {
+	if (perLevel) {
+		// Per-level statistics, then the average over all accesses
+		for (size_t i = 0; i < caches.numLevels(); ++i) {
+			const typename Hierarchy::Level& level = caches.level(i);
+			const TrafficStats& traffic = level.getTraffic();
+			printf("%s: accesses=%llu misses=%llu miss=%.03f writebacks=%llu up=%lluB down=%lluB\n",
+					level.getName().c_str(), static_cast<unsigned long long>(level.getHits() + level.getMisses()),
+					static_cast<unsigned long long>(level.getMisses()), level.hitMissCalculator(),
+					static_cast<unsigned long long>(traffic.writebacks + traffic.invalidationWritebacks),
+					static_cast<unsigned long long>(caches.bytesUp(i)), static_cast<unsigned long long>(caches.bytesDown(i)));
+		}
+		printf("AccTimeAvg=%.03f\n", caches.avgAccessTime());
+		printTraffic(caches);
+		printPrefetch(caches, config.BSizeBits);
+	} else {
+		double L1MissRate = caches.level(0).hitMissCalculator();
+		double L2MissRate = caches.level(1).hitMissCalculator();
+		double avgAccTime = caches.avgAccessTime();
+
+		printf("L1miss=%.03f ", L1MissRate);
+		printf("L2miss=%.03f ", L2MissRate);
+		printf("AccTimeAvg=%.03f\n", avgAccTime);
+		if (showTraffic) {
+			printTraffic(caches);
+		}
+		printPrefetch(caches, config.BSizeBits);
+	}
+}
+
+// Parallel run of a hierarchy sharded by set (see shardedSim.h); false when
+// the hierarchy cannot be sharded, to run it sequentially instead
+template <class Replacement>
+bool simulateSharded(const HierarchyConfig& config, TraceReader& trace, bool perLevel, bool showTraffic,
+		unsigned threads) {
+	for (const LevelConfig& level : config.levels) {
+		if (level.prefetch != PREFETCH_NONE) return false;
+	}
+	unsigned shardBits = 0;
+	while ((1u << shardBits) < 4 * threads) shardBits++;  // A few shards per thread, for balance
+	unsigned maxBits = ShardedSim<Replacement>::maxShardBits(config);
+	shardBits = shardBits < maxBits ? shardBits : maxBits;
+	if (!Replacement::PER_SET || shardBits == 0) return false;
+
+	ShardedSim<Replacement> sim(config, shardBits);
+	char unknown = 0;
+	int status = sim.run(trace, threads, unknown);
+	if (status == -2) {
+		cerr << "Unknown operation: " << unknown << endl;
+	} else if (status < 0) {
+		cout << "Command Format error" << endl;
+	} else {
+		printResults(sim.result(), config, perLevel, showTraffic);
+	}
+	return true;
+}
+
+// Simulate a trace on a hierarchy whose levels use one replacement policy
+template <class Replacement>
+int simulate(const HierarchyConfig& config, TraceReader& trace, bool perLevel, bool showTraffic, int verbosity,
+		const char* traceOut, unsigned threads, const char* instrumentOut, unsigned long int window) {
+	if (threads > 1 && verbosity == TRACE_QUIET && !traceOut && !instrumentOut &&
+			simulateSharded<Replacement>(config, trace, perLevel, showTraffic, threads)) {
+		return 0;
+	}
+	BasicHierarchy<Replacement> caches(config);
+
+	// The tracer exists only when some trace was asked for
+	FILE* traceFile = nullptr;
+	if (traceOut) {
+		traceFile = fopen(traceOut, "wb");
+		if (!traceFile) {
+			cerr << "Cannot open trace output" << endl;
+			return 0;
+		}
+	}
+	CacheTracer tracer(verbosity, stdout, traceFile);
+	CacheTracer* activeTracer = (verbosity > TRACE_QUIET || traceFile) ? &tracer : nullptr;
+	if (!tracer.writeHeader()) {
+		cerr << "Cannot write trace output" << endl;
+		return 0;
+	}
+	caches.setTracer(activeTracer);
+
+	// Miss instrumentation, only when asked for
+	FILE* instrumentFile = nullptr;
+	if (instrumentOut) {
+		instrumentFile = fopen(instrumentOut, "w");
+		if (!instrumentFile) {
+			cerr << "Cannot open instrumentation output" << endl;
+			return 0;
+		}
+	}
+	CacheInstrumentation instrumentation(instrumentFile ? config : HierarchyConfig(), window);
+	CacheInstrumentation* activeInstrumentation = instrumentFile ? &instrumentation : nullptr;
+	caches.setInstrumentation(activeInstrumentation);
+
+	char operation = 0; // read (r), write (w) or instruction fetch (i)
+	unsigned long int num = 0;
+	int status;
+	while ((status = trace.next(operation, num)) > 0) {
+		TRACE_ACCESS(activeTracer, operation, num);
+		INSTRUMENT_TRACE(activeInstrumentation, num);
+
+        if (operation == 'r') {
+            caches.read(num);
+        } else if (operation == 'w') {
+            caches.write(num);
+        } else if (operation == 'i') {
+            caches.fetch(num);
+        } else {
+            cerr << "Unknown operation: " << operation << endl;
+            return 0;
+        }
+	}
+	if (status < 0) {
+		// Operation appears in an Invalid format
+		cout << "Command Format error" << endl;
+		return 0;
+	}
+
+	printResults(caches, config, perLevel, showTraffic);
+
+	if (traceFile) {
+		fclose(traceFile);
+	}
+	if (instrumentFile) {
+		instrumentation.report(instrumentFile);
+		fclose(instrumentFile);
+	}
+
+	return 0;
+}
+
+// Sweep mode: every configuration of a sweep file over the trace, decoded once
+int runSweep(TraceReader& trace, const char* sweepFile, const char* sweepOut, unsigned threads) {
+	std::vector<SweepPoint> points;
+	size_t skipped = 0;
+	string error = loadSweep(sweepFile, points, skipped);
+	if (!error.empty()) {
+		cerr << "Error in sweep: " << error << endl;
+		return 0;
+	}
+	if (skipped) {
+		cerr << "Skipped " << skipped << " invalid configurations" << endl;
+	}
+
+	std::vector<SweepAccess> accesses;
+	SweepAccess access;
+	int status;
+	while ((status = trace.next(access.op, access.address)) > 0) {
+		if (access.op != 'r' && access.op != 'w' && access.op != 'i') {
+			cerr << "Unknown operation: " << access.op << endl;
+			return 0;
+		}
+		accesses.push_back(access);
+	}
+	if (status < 0) {
+		cout << "Command Format error" << endl;
+		return 0;
+	}
+
+	std::vector<SweepResult> results(points.size());
+	WorkStealingPool pool;
+	pool.run(points.size(), threads, [&](size_t i) {
+		results[i] = sweepRun(points[i].config(), accesses);
+	});
+
+	// CSV, or JSON for an output file named *.json
+	FILE* out = stdout;
+	string outName = sweepOut ? sweepOut : "";
+	if (sweepOut) {
+		out = fopen(sweepOut, "w");
+		if (!out) {
+			cerr << "Cannot open sweep output" << endl;
+			return 0;
+		}
+	}
+	bool json = outName.size() >= 5 && outName.compare(outName.size() - 5, 5, ".json") == 0;
+	writeSweep(out, json, points, results);
+	if (sweepOut) {
+		fclose(out);
+	}
+	return 0;
 }
 
 int main(int argc, char **argv) {
 
-	if (argc < 19) {
+	if (argc < 3) {
 		cerr << "Not enough arguments" << endl;
 		return 0;
 	}
@@ -35,9 +395,8 @@ int main(int argc, char **argv) {
 	// File
 	// Assuming it is the first argument
 	char* fileString = argv[1];
-	ifstream file(fileString); //input file stream
-	string line;
-	if (!file || !file.good()) {
+	TraceReader trace; // text or binary trace, mapped into memory
+	if (!trace.open(fileString)) {
 		// File doesn't exist or some other error
 		cerr << "File not found" << endl;
 		return 0;
@@ -46,7 +405,45 @@ int main(int argc, char **argv) {
 	unsigned MemCyc = 0, BSize = 0, L1Size = 0, L2Size = 0, L1Assoc = 0,
 			L2Assoc = 0, L1Cyc = 0, L2Cyc = 0, WrAlloc = 0;
 
-	for (int i = 2; i < 19; i += 2) {
+	// Write policy of both levels (--wr-back, default write-back) and the traffic report (--traffic 1)
+	unsigned WrBack = 1;
+	bool showTraffic = false;
+
+	// Tracing options (optional, after the cache parameters)
+	int verbosity = TRACE_QUIET;
+	const char* traceOut = nullptr;
+
+	// Stack-distance analysis (--stack-distance <max assoc>), instead of simulating
+	int stackAssoc = -1;
+	unsigned maxSize = 20;
+
+	// Hierarchy config file (--config <file>), instead of the --l1-*/--l2-* parameters
+	const char* configFile = nullptr;
+
+	// Multicore mode (--core-traces <trace>,<trace>,...): the first trace is core 0, each listed trace
+	// adds a core; --epoch local accesses per core between synchronizations.
+	// --threads host threads, for the cores of multicore mode, the set shards of a single hierarchy
+	// or the configurations of a sweep
+	const char* coreTraces = nullptr;
+	unsigned threads = 1, epoch = 1024, numHotLines = 5;
+
+	// Miss instrumentation report (--instrument <file>, see instrumentation.h), with working-set
+	// windows of --instrument-window accesses
+	const char* instrumentOut = nullptr;
+	unsigned long int window = 100000;
+
+	// Sweep mode (--sweep <file>, see sweep.h), results to stdout or --sweep-out <file>
+	const char* sweepFile = nullptr;
+	const char* sweepOut = nullptr;
+
+	// Prefetchers of the classic levels (--l1-prefetch, --l2-prefetch: none, next-line, stride, best-offset)
+	PrefetchKind L1Prefetch = PREFETCH_NONE, L2Prefetch = PREFETCH_NONE;
+	unsigned prefetchDegree = 1;
+
+	// Replacement policy of both levels (--replacement lru, plru, srrip, brrip, drrip, random or fifo)
+	ReplacementPolicy replacement = REPLACE_LRU;
+
+	for (int i = 2; i + 1 < argc; i += 2) {
 		string s(argv[i]);
 		if (s == "--mem-cyc") {
 			MemCyc = atoi(argv[i + 1]);
@@ -66,59 +463,102 @@ int main(int argc, char **argv) {
 			L2Assoc = atoi(argv[i + 1]);
 		} else if (s == "--wr-alloc") {
 			WrAlloc = atoi(argv[i + 1]);
+		} else if (s == "--wr-back") {
+			WrBack = atoi(argv[i + 1]);
+		} else if (s == "--traffic") {
+			showTraffic = atoi(argv[i + 1]) != 0;
+		} else if (s == "--verbose") {
+			verbosity = atoi(argv[i + 1]);
+		} else if (s == "--trace-out") {
+			traceOut = argv[i + 1];
+		} else if (s == "--stack-distance") {
+			stackAssoc = atoi(argv[i + 1]);
+		} else if (s == "--max-size") {
+			maxSize = atoi(argv[i + 1]);
+		} else if (s == "--config") {
+			configFile = argv[i + 1];
+		} else if (s == "--l1-prefetch" || s == "--l2-prefetch") {
+			if (!parsePrefetchKind(argv[i + 1], s == "--l1-prefetch" ? L1Prefetch : L2Prefetch)) {
+				cerr << "Error in arguments" << endl;
+				return 0;
+			}
+		} else if (s == "--replacement") {
+			if (!parseReplacementPolicy(argv[i + 1], replacement)) {
+				cerr << "Error in arguments" << endl;
+				return 0;
+			}
+		} else if (s == "--prefetch-degree") {
+			prefetchDegree = atoi(argv[i + 1]);
+		} else if (s == "--instrument") {
+			instrumentOut = argv[i + 1];
+		} else if (s == "--instrument-window") {
+			window = strtoul(argv[i + 1], nullptr, 10);
+		} else if (s == "--sweep") {
+			sweepFile = argv[i + 1];
+		} else if (s == "--sweep-out") {
+			sweepOut = argv[i + 1];
+		} else if (s == "--core-traces") {
+			coreTraces = argv[i + 1];
+		} else if (s == "--threads") {
+			threads = atoi(argv[i + 1]);
+		} else if (s == "--epoch") {
+			epoch = atoi(argv[i + 1]);
+		} else if (s == "--hot-lines") {
+			numHotLines = atoi(argv[i + 1]);
 		} else {
 			cerr << "Error in arguments" << endl;
 			return 0;
 		}
 	}
 
-    L1Cache l1Cache(MemCyc, BSize, L1Size, L1Assoc, L1Cyc, WrAlloc);
-    L2Cache l2Cache(MemCyc, BSize, L2Size, L2Assoc, L2Cyc, WrAlloc);
-	// Set L2 cache in L1 cache
-    l1Cache.setL2Cache(&l2Cache);
-
-	
-	while (getline(file, line)) {
-
-		stringstream ss(line);
-		string address;
-		char operation = 0; // read (R) or write (W)
-		if (!(ss >> operation >> address)) {
-			// Operation appears in an Invalid format
-			cout << "Command Format error" << endl;
+	if (stackAssoc >= 0) {
+		return runStackDistance(trace, BSize, static_cast<unsigned>(stackAssoc), maxSize);
+	}
+	if (sweepFile) {
+		return runSweep(trace, sweepFile, sweepOut, threads);
+	}
+	HierarchyConfig config;
+	if (configFile) {
+		string error = config.load(configFile);
+		if (!error.empty()) {
+			cerr << "Error in config: " << error << endl;
+			return 0;
+		}
+	} else {
+		if (argc < 19) {
+			cerr << "Not enough arguments" << endl;
+			return 0;
+		}
+		config = HierarchyConfig::twoLevel(MemCyc, BSize, L1Size, L1Assoc, L1Cyc, L2Size, L2Assoc, L2Cyc, WrAlloc);
+		for (LevelConfig& level : config.levels) {
+			level.WrBack = WrBack;
+			level.prefetchDegree = prefetchDegree;
+		}
+		config.levels[0].prefetch = L1Prefetch;
+		config.levels[1].prefetch = L2Prefetch;
+		config.replacement = replacement;
+		if (!config.validate().empty()) {
+			cerr << "Error in arguments" << endl;
 			return 0;
 		}
-
-		// DEBUG - remove this line
-		cout << "operation: " << operation;
-
-		string cutAddress = address.substr(2); // Removing the "0x" part of the address
-		// DEBUG - remove this line
-		cout << ", address (hex)" << cutAddress;
-
-		unsigned long int num = 0;
-		num = strtoul(cutAddress.c_str(), NULL, 16);
-
-		// DEBUG - remove this line
-		cout << " (dec) " << num << endl;
-
-        if (operation == 'r') {
-            l1Cache.read(num);
-        } else if (operation == 'w') {
-            l1Cache.write(num);
-        } else {
-            cerr << "Unknown operation: " << operation << endl;
-            return 0;
-        }
 	}
-
-    double L1MissRate = l1Cache.hitMissCalculator();
-    double L2MissRate = l2Cache.hitMissCalculator();
-    double avgAccTime = avgAccTimeCalculator(l1Cache, l2Cache, MemCyc);
-
-	printf("L1miss=%.03f ", L1MissRate);
-	printf("L2miss=%.03f ", L2MissRate);
-	printf("AccTimeAvg=%.03f\n", avgAccTime);
-
-	return 0;
+	if (coreTraces) {
+		return runMulticore(config, fileString, coreTraces, threads, epoch, numHotLines);
+	}
+	switch (config.replacement) {
+	case REPLACE_PLRU:
+		return simulate<PlruReplacement>(config, trace, configFile != nullptr, showTraffic, verbosity, traceOut, threads, instrumentOut, window);
+	case REPLACE_SRRIP:
+		return simulate<RripReplacement<RRIP_STATIC>>(config, trace, configFile != nullptr, showTraffic, verbosity, traceOut, threads, instrumentOut, window);
+	case REPLACE_BRRIP:
+		return simulate<RripReplacement<RRIP_BIMODAL>>(config, trace, configFile != nullptr, showTraffic, verbosity, traceOut, threads, instrumentOut, window);
+	case REPLACE_DRRIP:
+		return simulate<RripReplacement<RRIP_DYNAMIC>>(config, trace, configFile != nullptr, showTraffic, verbosity, traceOut, threads, instrumentOut, window);
+	case REPLACE_RANDOM:
+		return simulate<RandomReplacement>(config, trace, configFile != nullptr, showTraffic, verbosity, traceOut, threads, instrumentOut, window);
+	case REPLACE_FIFO:
+		return simulate<FifoReplacement>(config, trace, configFile != nullptr, showTraffic, verbosity, traceOut, threads, instrumentOut, window);
+	default:
+		return simulate<LruReplacement>(config, trace, configFile != nullptr, showTraffic, verbosity, traceOut, threads, instrumentOut, window);
+	}
 }
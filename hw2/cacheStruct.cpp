@@ -1,268 +1,570 @@
-#include <iostream>
-#include <unordered_map>
-#include <list>
-#include <vector>
-#include <cmath>
-#include <algorithm>
-
-// Global variables to indicate eviction in L2
-extern unsigned long int evictedAddressFromL2;
-extern bool evictionFlag;
-
-// Base class for cache simulation
-class Cache {
-public:
-    // Constructor to initialize the cache parameters
-    Cache(unsigned MemCyc, unsigned BSizeBits, unsigned SizeBits, unsigned AssocBits, unsigned Cyc, unsigned WrAlloc)
-        : MemCyc(MemCyc), BSizeBits(BSizeBits), SizeBits(SizeBits), AssocBits(AssocBits), Cyc(Cyc), WrAlloc(WrAlloc), hits(0), misses(0) {
-        unsigned numWays = 1 << AssocBits;
-        unsigned cacheSize = 1 << SizeBits;
-        unsigned blockSize = 1 << BSizeBits;
-        numSets = cacheSize / (numWays * blockSize);
-        cache.resize(numSets);
-    }
-
-    // Structure to represent a cache line
-    struct CacheLine {
-        unsigned long int tag;  // Tag of the cache line
-        bool valid;  // Validity of the cache line
-        bool operator==(const CacheLine& other) const {
-            return tag == other.tag && valid == other.valid;
-        }
-    };
-
-    virtual ~Cache() = default;
-
-    // Calculate the miss rate for the cache
-    double hitMissCalculator() const {
-        if (hits + misses == 0) return 0.0;
-        return static_cast<double>(misses) / (hits + misses);
-    }
-
-    // Get the access time for the cache
-    virtual double getAccessTime() const {
-        return static_cast<double>(Cyc);
-    }
-
-    // Pure virtual functions for reading and writing to the cache
-    virtual void read(unsigned long int address) = 0;
-    virtual void write(unsigned long int address) = 0;
-    virtual void evict(unsigned long int address) = 0;  // Pure virtual function for eviction
-    virtual void evictAndAdd(std::list<CacheLine>& set, unsigned long int tag) = 0;
-
-protected:
-    int hits;  // Number of cache hits
-    int misses;  // Number of cache misses
-    unsigned MemCyc;  // Memory access cycle time
-    unsigned BSizeBits;  // Block size in bits
-    unsigned SizeBits;  // Cache size in bits
-    unsigned AssocBits;  // Associativity in bits
-    unsigned Cyc;  // Cache access cycle time
-    unsigned WrAlloc;  // Write allocate policy
-    unsigned numSets;  // Number of sets in the cache
-
-
-    // Vector of lists to represent the cache sets and their lines
-    std::vector<std::list<CacheLine>> cache;
-
-    // Calculate the index from the address
-    unsigned getIndex(unsigned long int address) {
-        return (address >> BSizeBits) & (numSets - 1);
-    }
-
-    // Calculate the tag from the address
-    unsigned long int getTag(unsigned long int address) {
-        return address >> (BSizeBits + static_cast<unsigned>(std::log2(numSets)));
-    }
-
-    // Update the LRU order for a cache set
-    void updateLRU(std::list<CacheLine>& set, std::list<CacheLine>::iterator it) {
-        CacheLine line = *it;
-        set.erase(it);
-        set.push_front(line);
-    }
-
-    // Find a cache line in a set and update the LRU order if found
-    bool findAndUpdate(std::list<CacheLine>& set, unsigned long int tag) {
-        for (auto it = set.begin(); it != set.end(); ++it) {
-            if (it->tag == tag && it->valid) {
-                updateLRU(set, it);
-                return true;
-            }
-        }
-        return false;
-    }
-};
-
-// L1 cache class derived from the base Cache class
-class L1Cache : public Cache {
-public:
-    L1Cache(unsigned MemCyc, unsigned BSizeBits, unsigned SizeBits, unsigned AssocBits, unsigned Cyc, unsigned WrAlloc)
-        : Cache(MemCyc, BSizeBits, SizeBits, AssocBits, Cyc, WrAlloc) {}
-
-    // Read from the L1 cache
-    void read(unsigned long int address) override {
-        // Check for L2 eviction flag
-        if (evictionFlag) {
-            evict(evictedAddressFromL2);
-            evictionFlag = false; // Reset the flag
-        }
-
-        unsigned index = getIndex(address);
-        unsigned long int tag = getTag(address);
-        std::cout << "l1,r, Set number: " << index << std::endl;
-        std::cout << "l1,r, Tag number: " << tag << std::endl;
-        if (findAndUpdate(cache[index], tag)) {
-            hits++;
-            std::cout << "L1Cache Read Hit: " << address << std::endl;
-        } else {
-            misses++;
-            std::cout << "L1Cache Read Miss: " << address << std::endl;
-            if (l2Cache != nullptr) {
-                l2Cache->read(address);
-            }
-            evictAndAdd(cache[index], tag);
-        }
-    }
-
-    // Write to the L1 cache
-    void write(unsigned long int address) override {
-        // Check for L2 eviction flag
-        if (evictionFlag) {
-            evict(evictedAddressFromL2);
-            evictionFlag = false; // Reset the flag
-        }
-
-        unsigned index = getIndex(address);
-        unsigned long int tag = getTag(address);
-        std::cout << "l1,w, Set number: " << index << std::endl;
-        std::cout << "l1,w, Tag number: " << tag << std::endl;
-        if (findAndUpdate(cache[index], tag)) {
-            hits++;
-            std::cout << "L1Cache Write Hit: " << address << std::endl;
-        } else {
-            misses++;
-            std::cout << "L1Cache Write Miss: " << address << std::endl;
-            if (l2Cache != nullptr) {
-                l2Cache->write(address);
-            }
-            if (WrAlloc) { // WrAlloc == 1 (Write allocate)
-                evictAndAdd(cache[index], tag);
-            }
-        }
-    }
-
-    // Evict a cache line from L1
-    void evict(unsigned long int address) override {
-        unsigned index = getIndex(address);
-        unsigned long int tag = getTag(address);
-
-        auto it = std::find_if(cache[index].begin(), cache[index].end(), [tag](const CacheLine& line) {
-            return line.tag == tag && line.valid;
-        });
-
-        if (it != cache[index].end()) {
-            cache[index].erase(it);
-            std::cout << "L1Cache Evict: " << address << std::endl;
-        }
-    }
-
-    // Evict and add a new cache line in L1
-    void evictAndAdd(std::list<CacheLine>& set, unsigned long int tag) override {
-        if (set.size() >= (1u << AssocBits)) {
-            std::cout << "Evicted" << std::endl;
-            set.pop_back();
-        }
-        CacheLine line = { tag, true };
-        set.push_front(line);
-    }
-
-    // Set the L2 cache for inclusion policy
-    void setL2Cache(Cache* l2) {
-        l2Cache = l2;
-    }
-
-private:
-    Cache* l2Cache = nullptr;  // Pointer to the L2 cache
-};
-
-// L2 cache class derived from the base Cache class
-class L2Cache : public Cache {
-public:
-    L2Cache(unsigned MemCyc, unsigned BSizeBits, unsigned SizeBits, unsigned AssocBits, unsigned Cyc, unsigned WrAlloc)
-        : Cache(MemCyc, BSizeBits, SizeBits, AssocBits, Cyc, WrAlloc) {}
-
-    // Read from the L2 cache
-    void read(unsigned long int address) override {
-        unsigned index = getIndex(address);
-        unsigned long int tag = getTag(address);
-        std::cout << "l2,r, Set number: " << index << std::endl;
-        std::cout << "l2,r, Tag number: " << tag << std::endl;
-
-        if (findAndUpdate(cache[index], tag)) {
-            hits++;
-            std::cout << "L2Cache Read Hit: " << address << std::endl;
-        } else {
-            misses++;
-            std::cout << "L2Cache Read Miss: " << address << std::endl;
-            std::cout << "Fetch from main memory: " << address << std::endl;
-            evictAndAdd(cache[index], tag);
-        }
-    }
-
-    // Write to the L2 cache
-    void write(unsigned long int address) override {
-        unsigned index = getIndex(address);
-        unsigned long int tag = getTag(address);
-        std::cout << "l2,w, Set number: " << index << std::endl;
-        std::cout << "l2,w, Tag number: " << tag << std::endl;
-
-        if (findAndUpdate(cache[index], tag)) {
-            hits++;
-            std::cout << "L2Cache Write Hit: " << address << std::endl;
-        } else {
-            misses++;
-            std::cout << "L2Cache Write Miss: " << address << std::endl;
-            if (WrAlloc) { // WrAlloc == 1 (Write allocate)
-                evictAndAdd(cache[index], tag);
-            }
-        }
-    }
-
-    // Evict a cache line from L2
-    void evict(unsigned long int address) override {
-        unsigned index = getIndex(address);
-        unsigned long int tag = getTag(address);
-
-        auto it = std::find_if(cache[index].begin(), cache[index].end(), [tag](const CacheLine& line) {
-            return line.tag == tag && line.valid;
-        });
-
-        if (it != cache[index].end()) {
-            cache[index].erase(it);
-            std::cout << "L2Cache Evict: " << address << std::endl;
-        }
-    }
-
-    // Evict and add a new cache line in L2
-    void evictAndAdd(std::list<CacheLine>& set, unsigned long int tag) override {
-        if (set.size() >= (1u << AssocBits)) {
-            auto evictedLine = set.back();
-            if (evictedLine.valid) {
-                evictionFlag = true;
-                evictedAddressFromL2 = (evictedLine.tag << (BSizeBits + static_cast<unsigned>(std::log2(numSets)))) + (std::distance(cache.begin(), std::find(cache.begin(), cache.end(), set)));
-            }
-            set.pop_back();
-        }
-        CacheLine line = { tag, true };
-        set.push_front(line);
-    }
-
-    // Set the L1 cache for inclusion policy
-    void setL1Cache(Cache* l1) {
-        l1Cache = l1;
-    }
-
-private:
-    Cache* l1Cache = nullptr;  // Pointer to the L1 cache for inclusion policy
-};
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "cacheAddress.h"
+#include "cacheConfig.h"
+#include "cacheTrace.h"
+#include "instrumentation.h"
+#include "prefetcher.h"
+#include "replacement.h"
+
+// Blocks and writes a level sent to or received from its next level
+struct TrafficStats {
+    uint64_t fills = 0;                   // Blocks brought in from below
+    uint64_t writebacks = 0;              // Dirty blocks written below on eviction
+    uint64_t invalidationWritebacks = 0;  // Dirty blocks of back-invalidated upper copies written below
+    uint64_t victims = 0;                 // Clean blocks handed to an exclusive next level
+    uint64_t writeThroughs = 0;           // Writes passed below without their block
+
+    void add(const TrafficStats& other) {
+        fills += other.fills;
+        writebacks += other.writebacks;
+        invalidationWritebacks += other.invalidationWritebacks;
+        victims += other.victims;
+        writeThroughs += other.writeThroughs;
+    }
+};
+
+template <class Replacement> class BasicHierarchy;
+template <class Replacement> class MulticoreSim;
+
+// One level of a cache hierarchy
+// The lines of all sets live in one flat tag array, numWays tags per set, so a
+// lookup is a short linear scan over contiguous memory. The replacement
+// policy (see replacement.h) is a template parameter and keeps its own
+// per-set state.
+// A level knows nothing of the levels around it: BasicHierarchy moves blocks
+// between levels and keeps the hit, miss and traffic counts.
+template <class Replacement>
+class BasicCache {
+public:
+    // Constructor to initialize the cache parameters
+    BasicCache(const std::string& name, unsigned BSizeBits, unsigned SizeBits, unsigned AssocBits, unsigned Cyc, unsigned WrAlloc,
+          unsigned WrBack)
+        : name(name), hits(0), misses(0), BSizeBits(BSizeBits), SizeBits(SizeBits), AssocBits(AssocBits), Cyc(Cyc), WrAlloc(WrAlloc),
+          WrBack(WrBack) {
+        numWays = 1u << AssocBits;
+        unsigned long int cacheSize = 1ul << SizeBits;
+        unsigned long int blockSize = 1ul << BSizeBits;
+        numSets = static_cast<unsigned>(cacheSize / (numWays * blockSize));
+        setBits = static_cast<unsigned>(std::log2(numSets));
+        tags.assign(static_cast<size_t>(numSets) * numWays, 0);
+        dirty.assign(tags.size(), 0);
+        replacement.init(numSets, numWays);
+    }
+
+    // Calculate the miss rate for the cache
+    double hitMissCalculator() const {
+        if (hits + misses == 0) return 0.0;
+        return static_cast<double>(misses) / (hits + misses);
+    }
+
+    // Get the access time for the cache
+    double getAccessTime() const {
+        return static_cast<double>(Cyc);
+    }
+
+    const std::string& getName() const { return name; }
+    uint64_t getHits() const { return hits; }
+    uint64_t getMisses() const { return misses; }
+    const TrafficStats& getTraffic() const { return traffic; }
+
+    // Calculate the index from the address
+    unsigned getIndex(unsigned long int address) const {
+        return blockIndex(address, BSizeBits, numSets);
+    }
+
+    // Calculate the tag from the address
+    unsigned long int getTag(unsigned long int address) const {
+        return blockTag(address, BSizeBits, setBits);
+    }
+
+    // Rebuild the address of a block from its set index and tag
+    unsigned long int getAddress(unsigned index, unsigned long int tag) const {
+        return (tag << (BSizeBits + setBits)) | (static_cast<unsigned long int>(index) << BSizeBits);
+    }
+
+protected:
+    template <class> friend class BasicHierarchy;
+    template <class> friend class MulticoreSim;
+
+    static const unsigned long int VALID = VALID_TAG;
+
+    std::string name;  // Name of the level, for reports and traces
+    uint64_t hits;  // Number of cache hits
+    uint64_t misses;  // Number of cache misses
+    unsigned BSizeBits;  // Block size in bits
+    unsigned SizeBits;  // Cache size in bits
+    unsigned AssocBits;  // Associativity in bits
+    unsigned Cyc;  // Cache access cycle time
+    unsigned WrAlloc;  // Write allocate policy
+    unsigned WrBack;  // Write-back (1) or write-through (0) policy
+    TrafficStats traffic;  // Transfers to and from the next level
+    unsigned numSets;  // Number of sets in the cache
+    unsigned numWays;  // Lines per set
+    unsigned setBits;  // log2(numSets)
+
+    // Tags of all lines (VALID | tag), set by set
+    std::vector<unsigned long int> tags;
+    // Dirty bit of every line (write-back levels only)
+    std::vector<uint8_t> dirty;
+    Replacement replacement;
+    // Lines brought in by a prefetch and not used yet, and when their fills
+    // complete (levels with a prefetcher only)
+    std::vector<uint8_t> prefetched;
+    std::vector<uint64_t> readyAt;
+
+    // Find the way holding a tag in a set, or numWays when absent. The loop
+    // has no early exit, so the compiler can vectorize the compares.
+    unsigned findWay(unsigned index, unsigned long int tag) const {
+        const unsigned long int* set = &tags[static_cast<size_t>(index) * numWays];
+        unsigned long int key = tag | VALID;
+        unsigned way = numWays;
+        for (unsigned w = 0; w < numWays; ++w) {
+            way = set[w] == key ? w : way;
+        }
+        return way;
+    }
+
+    // A line was used: tell the replacement policy
+    void touch(unsigned index, unsigned way) {
+        replacement.hit(index, way);
+    }
+
+    // Invalidate a line
+    void invalidate(unsigned index, unsigned way) {
+        replacement.remove(index, way);
+        tags[static_cast<size_t>(index) * numWays + way] = 0;
+        dirty[static_cast<size_t>(index) * numWays + way] = 0;
+        if (!prefetched.empty()) prefetched[static_cast<size_t>(index) * numWays + way] = 0;
+    }
+
+    // The way to replace in a set
+    unsigned victimWay(unsigned index) {
+        return replacement.victim(index, &tags[static_cast<size_t>(index) * numWays]);
+    }
+
+    // Store a tag in a way
+    void fill(unsigned index, unsigned way, unsigned long int tag, bool isDirty) {
+        tags[static_cast<size_t>(index) * numWays + way] = tag | VALID;
+        dirty[static_cast<size_t>(index) * numWays + way] = isDirty;
+        if (!prefetched.empty()) prefetched[static_cast<size_t>(index) * numWays + way] = 0;
+        replacement.fill(index, way);
+    }
+};
+
+// A tree of cache levels in front of memory
+// Every level misses into at most one next level; accesses enter at the data
+// or the instruction entry level and walk down until they hit. The levels are
+// held by value and walked by index, with the inclusion and write policies of
+// each level selecting its behaviour, so an access makes no virtual calls.
+// A write is performed by the first level that ends up holding its block; a
+// write-back level then keeps it as a dirty line, a write-through level passes
+// it on. Write-backs and write-throughs are not counted as accesses of the
+// level they reach, but they update its replacement state.
+// Prefetches are issued after the access that triggered them and fill like
+// read misses, but are not counted as accesses of the levels below. For
+// timeliness, one access is taken to start per cycle: a prefetched block hit
+// before the cycles of its fill have passed is a late prefetch, and the hit
+// also waits for the cycles of the fill that remain.
+template <class Replacement>
+class BasicHierarchy {
+public:
+    typedef BasicCache<Replacement> Level;
+
+    explicit BasicHierarchy(const HierarchyConfig& config)
+        : MemCyc(config.MemCyc), blockBytes(1ul << config.BSizeBits), wordBytes(config.WordSize),
+          memoryReadBytes(0), memoryWriteBytes(0) {
+        for (const LevelConfig& level : config.levels) {
+            levels.emplace_back(level.name, config.BSizeBits, level.SizeBits, level.AssocBits, level.Cyc, level.WrAlloc,
+                                level.WrBack);
+            inclusion.push_back(level.inclusion);
+            prefetchers.emplace_back(level.prefetch, level.prefetchDegree, config.BSizeBits);
+            if (level.prefetch != PREFETCH_NONE) {
+                levels.back().prefetched.assign(levels.back().tags.size(), 0);
+                levels.back().readyAt.assign(levels.back().tags.size(), 0);
+            }
+        }
+        above.resize(levels.size());
+        for (size_t i = 0; i < levels.size(); ++i) {
+            next.push_back(config.nextOf(i));
+            if (next[i] >= 0) above[next[i]].push_back(static_cast<int>(i));
+        }
+        dataEntry = config.data.empty() ? 0 : config.find(config.data);
+        instructionEntry = config.instructions.empty() ? dataEntry : config.find(config.instructions);
+        entryAccesses.assign(levels.size(), 0);
+    }
+
+    // Attach a tracer for per-access events (null to stop tracing)
+    void setTracer(CacheTracer* t) {
+        tracer = t;
+    }
+
+    // Attach miss instrumentation (null to stop it)
+    void setInstrumentation(CacheInstrumentation* i) {
+        instrumentation = i;
+    }
+
+    // Data read
+    void read(unsigned long int address) {
+        entryAccesses[dataEntry]++;
+        access(dataEntry, address, false, false, false, false);
+        clock++;
+        if (!pendingPrefetches.empty()) issuePrefetches();
+    }
+
+    // Data write
+    void write(unsigned long int address) {
+        entryAccesses[dataEntry]++;
+        access(dataEntry, address, true, false, false, false);
+        clock++;
+        if (!pendingPrefetches.empty()) issuePrefetches();
+    }
+
+    // Instruction fetch
+    void fetch(unsigned long int address) {
+        entryAccesses[instructionEntry]++;
+        access(instructionEntry, address, false, false, false, false);
+        clock++;
+        if (!pendingPrefetches.empty()) issuePrefetches();
+    }
+
+    size_t numLevels() const { return levels.size(); }
+    const Level& level(size_t i) const { return levels[i]; }
+
+    // Accesses of the trace, over all entry levels
+    uint64_t accesses() const {
+        uint64_t total = 0;
+        for (uint64_t n : entryAccesses) total += n;
+        return total;
+    }
+
+    // Add the counts of a hierarchy of the same levels (a shard of a trace)
+    void merge(const BasicHierarchy& other) {
+        for (size_t i = 0; i < levels.size(); ++i) {
+            levels[i].hits += other.levels[i].hits;
+            levels[i].misses += other.levels[i].misses;
+            levels[i].traffic.add(other.levels[i].traffic);
+            entryAccesses[i] += other.entryAccesses[i];
+            prefetchers[i].stats.issued += other.prefetchers[i].stats.issued;
+            prefetchers[i].stats.useful += other.prefetchers[i].stats.useful;
+            prefetchers[i].stats.late += other.prefetchers[i].stats.late;
+            prefetchers[i].stats.lateCycles += other.prefetchers[i].stats.lateCycles;
+        }
+        memoryReadBytes += other.memoryReadBytes;
+        memoryWriteBytes += other.memoryWriteBytes;
+        clock += other.clock;
+    }
+
+    // Prefetcher of a level, with its statistics
+    const Prefetcher& prefetcher(size_t i) const { return prefetchers[i]; }
+
+    // Bytes moved from and to memory
+    uint64_t getMemoryReadBytes() const { return memoryReadBytes; }
+    uint64_t getMemoryWriteBytes() const { return memoryWriteBytes; }
+
+    // Bytes a level sent to its next level (write-backs, victims and write-throughs)
+    uint64_t bytesDown(size_t i) const {
+        const TrafficStats& t = levels[i].traffic;
+        return (t.writebacks + t.invalidationWritebacks + t.victims) * blockBytes + t.writeThroughs * wordBytes;
+    }
+
+    // Bytes a level received from its next level (block fills)
+    uint64_t bytesUp(size_t i) const {
+        return levels[i].traffic.fills * blockBytes;
+    }
+
+    // Average time of an access from a level down to memory:
+    // T(level) = cycles + late prefetch cycles per access + miss rate * T(next level),
+    // with T(memory) = MemCyc
+    double accessTime(int i) const {
+        if (i < 0) return MemCyc;
+        const Level& cache = levels[i];
+        uint64_t accesses = cache.hits + cache.misses;
+        double wait = accesses ? static_cast<double>(prefetchers[i].stats.lateCycles) / accesses : 0.0;
+        return cache.getAccessTime() + wait + cache.hitMissCalculator() * accessTime(next[i]);
+    }
+
+    // Average access time over all accesses, weighing each entry level by its accesses
+    double avgAccessTime() const {
+        uint64_t total = 0;
+        double time = 0;
+        for (size_t i = 0; i < levels.size(); ++i) {
+            total += entryAccesses[i];
+            time += entryAccesses[i] * accessTime(static_cast<int>(i));
+        }
+        return total ? time / total : accessTime(dataEntry);
+    }
+
+private:
+    std::vector<Level> levels;
+    std::vector<InclusionPolicy> inclusion;  // Of each level, towards the levels above it
+    std::vector<int> next;                   // Level missed into, -1 for memory
+    std::vector<std::vector<int>> above;     // Levels that miss into each level
+    std::vector<uint64_t> entryAccesses;     // Accesses that started at each level
+    int dataEntry;
+    int instructionEntry;
+    unsigned MemCyc;  // Memory access cycle time
+    unsigned long int blockBytes;
+    unsigned long int wordBytes;
+    uint64_t memoryReadBytes;
+    uint64_t memoryWriteBytes;
+    CacheTracer* tracer = nullptr;  // Event tracer, null when not tracing
+    CacheInstrumentation* instrumentation = nullptr;  // Null unless instrumenting
+    std::vector<Prefetcher> prefetchers;  // Of each level, disabled when it has none
+    std::vector<unsigned long int> proposed;  // Blocks a prefetcher just proposed
+    std::vector<std::pair<int, unsigned long int>> pendingPrefetches;  // Level and address
+    uint64_t clock = 0;  // Accesses completed
+
+    // Access a level.
+    // aboveAllocates: the level above will allocate the block
+    // writeDone: the write is performed by a level above
+    // prefetch: the block is fetched for a prefetch of a level above; it is
+    // not a demand access, so it is not counted, traced or instrumented and
+    // does not use the prefetched lines it hits
+    // Returns true when the block is handed up dirty (exclusive levels only).
+    bool access(int l, unsigned long int address, bool isWrite, bool aboveAllocates, bool writeDone, bool prefetch) {
+        Level& cache = levels[l];
+        unsigned index = cache.getIndex(address);
+        unsigned long int tag = cache.getTag(address);
+        unsigned way = cache.findWay(index, tag);
+        bool writesHere = isWrite && !writeDone;
+        if (way != cache.numWays) {
+            if (!prefetch) {
+                cache.hits++;
+                TRACE_EVENT(tracer, l + 1, cache.name.c_str(), isWrite ? EV_WRITE_HIT : EV_READ_HIT, index, tag, address);
+                INSTRUMENT_LEVEL(instrumentation, l, index, address, true);
+            }
+            size_t line = static_cast<size_t>(index) * cache.numWays + way;
+            bool prefetchHit = !cache.prefetched.empty() && cache.prefetched[line];
+            if (prefetchHit && !prefetch) usePrefetch(l, line);
+            if (prefetchers[l].enabled()) prefetchers[l].access(address, prefetchHit, proposed);
+            if (!proposed.empty()) queuePrefetches(l);
+            if (inclusion[l] == EXCLUSIVE && aboveAllocates) {
+                // The block moves up to the level that missed
+                bool wasDirty = cache.dirty[line];
+                cache.invalidate(index, way);
+                return wasDirty;
+            }
+            cache.touch(index, way);
+            if (writesHere) {
+                if (cache.WrBack) {
+                    cache.dirty[line] = 1;
+                } else {
+                    writeThrough(l, address);
+                }
+            }
+            return false;
+        }
+
+        if (!prefetch) {
+            cache.misses++;
+            TRACE_EVENT(tracer, l + 1, cache.name.c_str(), isWrite ? EV_WRITE_MISS : EV_READ_MISS, index, tag, address);
+            INSTRUMENT_LEVEL(instrumentation, l, index, address, false);
+        }
+        if (prefetchers[l].enabled()) {
+            prefetchers[l].access(address, true, proposed);
+            queuePrefetches(l);
+        }
+        bool allocate = !isWrite || cache.WrAlloc;
+        // An exclusive level only receives the victims of the levels above it
+        bool fills = allocate && !(inclusion[l] == EXCLUSIVE && aboveAllocates);
+        bool keepsWrite = writesHere && fills && cache.WrBack;
+        if (writesHere && !keepsWrite) {
+            cache.traffic.writeThroughs++;  // The write goes on below, with the miss
+        }
+        bool suppliedDirty = false;
+        if (next[l] >= 0) {
+            suppliedDirty = access(next[l], address, isWrite, fills || aboveAllocates, writeDone || keepsWrite, prefetch);
+        } else {
+            if (fills || aboveAllocates) memoryReadBytes += blockBytes;
+            if (writesHere && !keepsWrite) memoryWriteBytes += wordBytes;
+        }
+        if (fills) {
+            cache.traffic.fills++;
+            if (suppliedDirty && !cache.WrBack) {
+                // A write-through level holds no dirty data
+                cache.traffic.writebacks++;
+                writeBackBlock(next[l], address);
+                suppliedDirty = false;
+            }
+            allocateBlock(l, index, tag, keepsWrite || suppliedDirty);
+            return false;
+        }
+        return suppliedDirty;
+    }
+
+    void queuePrefetches(int l) {
+        for (unsigned long int address : proposed) pendingPrefetches.push_back(std::make_pair(l, address));
+        proposed.clear();
+    }
+
+    // A demand access hit a prefetched line for the first time
+    void usePrefetch(int l, size_t line) {
+        Level& cache = levels[l];
+        cache.prefetched[line] = 0;
+        prefetchers[l].stats.useful++;
+        if (clock < cache.readyAt[line]) {
+            prefetchers[l].stats.late++;
+            prefetchers[l].stats.lateCycles += cache.readyAt[line] - clock;
+        }
+    }
+
+    // Issue the prefetches of the last access; those of lower levels may be
+    // queued meanwhile, as their prefetchers see the upper prefetches
+    void issuePrefetches() {
+        for (size_t i = 0; i < pendingPrefetches.size(); ++i) {
+            prefetchBlock(pendingPrefetches[i].first, pendingPrefetches[i].second);
+        }
+        pendingPrefetches.clear();
+    }
+
+    // Bring a block into a level ahead of demand
+    void prefetchBlock(int l, unsigned long int address) {
+        Level& cache = levels[l];
+        unsigned index = cache.getIndex(address);
+        unsigned long int tag = cache.getTag(address);
+        if (cache.findWay(index, tag) != cache.numWays) return;
+
+        // The fill takes the cycles of every level it misses, and of the one that supplies it
+        uint64_t latency = 0;
+        int n = next[l];
+        while (n >= 0) {
+            const Level& below = levels[n];
+            latency += below.Cyc;
+            unsigned belowIndex = below.getIndex(address);
+            if (below.findWay(belowIndex, below.getTag(address)) != below.numWays) break;
+            n = next[n];
+        }
+        if (n < 0) latency += MemCyc;
+        bool suppliedDirty = false;
+        if (next[l] >= 0) {
+            suppliedDirty = access(next[l], address, false, true, false, true);
+        } else {
+            memoryReadBytes += blockBytes;
+        }
+
+        cache.traffic.fills++;
+        if (suppliedDirty && !cache.WrBack) {
+            cache.traffic.writebacks++;
+            writeBackBlock(next[l], address);
+            suppliedDirty = false;
+        }
+        allocateBlock(l, index, tag, suppliedDirty);
+        size_t line = static_cast<size_t>(index) * cache.numWays + cache.findWay(index, tag);
+        cache.prefetched[line] = 1;
+        cache.readyAt[line] = clock + latency;
+        prefetchers[l].stats.issued++;
+    }
+
+    // Pass a write that a write-through level performed to the level below
+    void writeThrough(int l, unsigned long int address) {
+        levels[l].traffic.writeThroughs++;
+        int n = next[l];
+        if (n < 0) {
+            memoryWriteBytes += wordBytes;
+            return;
+        }
+        Level& cache = levels[n];
+        unsigned index = cache.getIndex(address);
+        unsigned way = cache.findWay(index, cache.getTag(address));
+        if (way != cache.numWays) {
+            cache.touch(index, way);
+            if (cache.WrBack) {
+                cache.dirty[static_cast<size_t>(index) * cache.numWays + way] = 1;
+                return;
+            }
+        }
+        // Written through again, or around a level without the block
+        writeThrough(n, address);
+    }
+
+    // Write a dirty block back into a level (or memory), which marks its copy dirty
+    void writeBackBlock(int l, unsigned long int address) {
+        if (l < 0) {
+            memoryWriteBytes += blockBytes;
+            return;
+        }
+        Level& cache = levels[l];
+        unsigned index = cache.getIndex(address);
+        unsigned long int tag = cache.getTag(address);
+        unsigned way = cache.findWay(index, tag);
+        if (way != cache.numWays) {
+            cache.touch(index, way);
+            if (cache.WrBack) {
+                cache.dirty[static_cast<size_t>(index) * cache.numWays + way] = 1;
+            } else {
+                cache.traffic.writebacks++;
+                writeBackBlock(next[l], address);
+            }
+        } else if (inclusion[l] == EXCLUSIVE) {
+            allocateBlock(l, index, tag, true);
+        } else {
+            // Not held here (non-inclusive): the block goes further down
+            cache.traffic.writebacks++;
+            writeBackBlock(next[l], address);
+        }
+    }
+
+    // Put a block in a level, handling the block it replaces
+    void allocateBlock(int l, unsigned index, unsigned long int tag, bool isDirty) {
+        Level& cache = levels[l];
+        unsigned way = cache.victimWay(index);
+        size_t line = static_cast<size_t>(index) * cache.numWays + way;
+        unsigned long int evictedTag = cache.tags[line];
+        bool evictedDirty = cache.dirty[line];
+        cache.fill(index, way, tag, isDirty && cache.WrBack);
+        if (!(evictedTag & Level::VALID)) return;
+
+        unsigned long int evictedAddress = cache.getAddress(index, evictedTag & ~Level::VALID);
+        TRACE_EVENT(tracer, l + 1, cache.name.c_str(), EV_EVICT, index, evictedTag & ~Level::VALID, evictedAddress);
+        // Inclusion: the evicted block leaves the levels above as well, with
+        // any newer data they held
+        if (inclusion[l] == INCLUSIVE && backInvalidate(l, evictedAddress) && !evictedDirty) {
+            cache.traffic.invalidationWritebacks++;
+            evictedDirty = true;
+        } else if (evictedDirty) {
+            cache.traffic.writebacks++;
+        }
+        if (evictedDirty) {
+            writeBackBlock(next[l], evictedAddress);
+        } else if (next[l] >= 0 && inclusion[next[l]] == EXCLUSIVE) {
+            // A clean victim of this level goes to an exclusive next level too
+            Level& victims = levels[next[l]];
+            unsigned victimIndex = victims.getIndex(evictedAddress);
+            unsigned long int victimTag = victims.getTag(evictedAddress);
+            unsigned victimWay = victims.findWay(victimIndex, victimTag);
+            if (victimWay != victims.numWays) {
+                victims.touch(victimIndex, victimWay);
+            } else {
+                cache.traffic.victims++;
+                allocateBlock(next[l], victimIndex, victimTag, false);
+            }
+        }
+    }
+
+    // Remove a block from every level above a level; true when a removed copy was dirty
+    bool backInvalidate(int l, unsigned long int address) {
+        bool wasDirty = false;
+        for (int u : above[l]) {
+            Level& cache = levels[u];
+            unsigned index = cache.getIndex(address);
+            unsigned long int tag = cache.getTag(address);
+            unsigned way = cache.findWay(index, tag);
+            if (way != cache.numWays) {
+                wasDirty = wasDirty || cache.dirty[static_cast<size_t>(index) * cache.numWays + way];
+                cache.invalidate(index, way);
+                TRACE_EVENT(tracer, u + 1, cache.name.c_str(), EV_INVALIDATE, index, tag, address);
+            }
+            wasDirty = backInvalidate(u, address) || wasDirty;
+        }
+        return wasDirty;
+    }
+};
+
+// The LRU level and hierarchy
+typedef BasicCache<LruReplacement> Cache;
+typedef BasicHierarchy<LruReplacement> CacheHierarchy;
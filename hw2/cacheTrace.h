@@ -0,0 +1,118 @@
+#ifndef CACHE_TRACE_H
+#define CACHE_TRACE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+// Per-access tracing of the cache hierarchy.
+// Text tracing is selected at run time by a verbosity level; a binary event
+// trace (fixed-size TraceRecord entries after a TraceHeader) can be written at
+// the same time. Caches hold a CacheTracer pointer that is null unless tracing
+// was asked for, so the only cost of an untraced run is that null test.
+// Building with -DCACHE_NO_TRACE removes the trace calls altogether.
+
+enum TraceVerbosity {
+    TRACE_QUIET = 0,   // Only the final statistics line
+    TRACE_EVENTS = 1,  // One line per hit, miss, eviction and invalidation
+    TRACE_DETAIL = 2   // Also every access with its set and tag
+};
+
+enum TraceEventKind : uint8_t {
+    EV_READ_HIT = 0,
+    EV_READ_MISS = 1,
+    EV_WRITE_HIT = 2,
+    EV_WRITE_MISS = 3,
+    EV_EVICT = 4,       // Replaced to make room for a new block
+    EV_INVALIDATE = 5   // Removed by back-invalidation from the level below
+};
+
+// Binary trace layout (native byte order)
+#define CACHE_TRACE_MAGIC "CTRC"
+#define CACHE_TRACE_VERSION 1
+
+struct TraceHeader {
+    char magic[4];     // CACHE_TRACE_MAGIC
+    uint32_t version;  // CACHE_TRACE_VERSION
+    uint32_t recordSize;  // sizeof(TraceRecord)
+    uint32_t reserved;
+};
+
+struct TraceRecord {
+    uint64_t address;  // Block address (offset bits cleared for evictions)
+    uint64_t tag;
+    uint32_t access;   // Index of the trace access that caused the event
+    uint32_t set;
+    uint8_t level;     // Position of the cache level in the hierarchy, from 1
+    uint8_t kind;      // TraceEventKind
+    uint8_t op;        // 'r', 'w' or 'i' of the access
+    uint8_t pad[5];
+};
+
+class CacheTracer {
+public:
+    CacheTracer(int verbosity, FILE* text, FILE* binary)
+        : verbosity(verbosity), text(text), binary(binary), access(0), op(0) {}
+
+    // Write the binary trace header; false when the write fails
+    bool writeHeader() {
+        if (!binary) return true;
+        TraceHeader header;
+        memcpy(header.magic, CACHE_TRACE_MAGIC, 4);
+        header.version = CACHE_TRACE_VERSION;
+        header.recordSize = sizeof(TraceRecord);
+        header.reserved = 0;
+        return fwrite(&header, sizeof(header), 1, binary) == 1;
+    }
+
+    // Start a new access of the trace
+    void beginAccess(char operation, unsigned long int address) {
+        access++;
+        op = operation;
+        if (verbosity >= TRACE_DETAIL && text) {
+            fprintf(text, "access %u: %c 0x%08lx\n", access, operation, address);
+        }
+    }
+
+    // Record an event of one cache level
+    void event(unsigned level, const char* name, TraceEventKind kind, unsigned set, unsigned long int tag,
+               unsigned long int address) {
+        static const char* names[] = { "read hit", "read miss", "write hit", "write miss", "evict", "invalidate" };
+        if (verbosity >= TRACE_DETAIL && text) {
+            fprintf(text, "  %s %s 0x%08lx (set %u, tag 0x%lx)\n", name, names[kind], address, set, tag);
+        } else if (verbosity >= TRACE_EVENTS && text) {
+            fprintf(text, "%s %s 0x%08lx\n", name, names[kind], address);
+        }
+        if (binary) {
+            TraceRecord record;
+            memset(&record, 0, sizeof(record));
+            record.address = address;
+            record.tag = tag;
+            record.access = access;
+            record.set = set;
+            record.level = static_cast<uint8_t>(level);
+            record.kind = kind;
+            record.op = static_cast<uint8_t>(op);
+            fwrite(&record, sizeof(record), 1, binary);
+        }
+    }
+
+private:
+    int verbosity;
+    FILE* text;      // Text trace, or null
+    FILE* binary;    // Binary event trace, or null
+    uint32_t access; // Accesses begun so far
+    char op;         // Operation of the current access
+};
+
+#ifdef CACHE_NO_TRACE
+#define TRACE_ACCESS(tracer, op, address) do { } while (0)
+#define TRACE_EVENT(tracer, level, name, kind, set, tag, address) do { } while (0)
+#else
+#define TRACE_ACCESS(tracer, op, address) \
+    do { if (tracer) (tracer)->beginAccess(op, address); } while (0)
+#define TRACE_EVENT(tracer, level, name, kind, set, tag, address) \
+    do { if (tracer) (tracer)->event(level, name, kind, set, tag, address); } while (0)
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef EPOCH_BARRIER_H
+#define EPOCH_BARRIER_H
+
+#include <condition_variable>
+#include <mutex>
+
+// Barrier for a fixed number of threads, reusable across epochs
+class EpochBarrier {
+public:
+    explicit EpochBarrier(unsigned count) : count(count), waiting(0), generation(0) {}
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        unsigned long int current = generation;
+        if (++waiting == count) {
+            waiting = 0;
+            generation++;
+            cv.notify_all();
+        } else {
+            cv.wait(lock, [&] { return generation != current; });
+        }
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    unsigned count;
+    unsigned waiting;
+    unsigned long int generation;
+};
+
+#endif
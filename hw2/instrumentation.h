@@ -0,0 +1,244 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "cacheConfig.h"
+
+// Miss analysis of a run, turned on with --instrument:
+//   3C       every demand miss of a level is compulsory (first access of the
+//            block at that level), capacity (also a miss of a fully
+//            associative LRU cache of the same size, run as a shadow of the
+//            level) or conflict (the shadow hits)
+//   heatmap  demand accesses and misses of every set of every level
+//   reuse    histogram of the reuse distances of the trace: the number of
+//            distinct blocks accessed between two accesses of a block
+//   working  distinct blocks accessed in each window of the trace
+// Like the tracer, the hierarchy holds a pointer that is null unless asked
+// for; building with -DCACHE_NO_INSTRUMENT removes the hooks altogether.
+
+// Reuse distances, online: a Fenwick tree over time slots holds a 1 at the
+// latest access of every block, so a distance is one range sum. When the
+// slots run out, the live ones are renumbered in order, which keeps the
+// tree at a few times the number of distinct blocks.
+class ReuseDistance {
+public:
+    ReuseDistance() : nextSlot(0), cold(0) { resize(1024); }
+
+    void access(unsigned long int block) {
+        auto it = lastSlot.find(block);
+        if (it != lastSlot.end()) {
+            uint64_t distance = prefixSum(nextSlot) - prefixSum(it->second + 1);
+            unsigned bucket = 0;
+            while (bucket < 63 && (1ull << bucket) <= distance) bucket++;
+            if (histogram.size() <= bucket) histogram.resize(bucket + 1, 0);
+            histogram[bucket]++;
+            add(it->second, -1);
+            slotBlocks[it->second] = NO_BLOCK;
+        } else {
+            cold++;
+        }
+        if (nextSlot == slotBlocks.size()) compact();
+        add(nextSlot, 1);
+        slotBlocks[nextSlot] = block;
+        lastSlot[block] = nextSlot++;
+    }
+
+    // Bucket 0 is distance 0, bucket k distances 2^(k-1) to 2^k - 1
+    const std::vector<uint64_t>& getHistogram() const { return histogram; }
+    uint64_t getCold() const { return cold; }
+
+private:
+    static const unsigned long int NO_BLOCK = ~0ul;
+
+    std::unordered_map<unsigned long int, uint32_t> lastSlot;  // Slot of the latest access of each block
+    std::vector<unsigned long int> slotBlocks;  // Block of each live slot, NO_BLOCK for dead ones
+    std::vector<int32_t> fenwick;
+    uint32_t nextSlot;
+    uint64_t cold;  // First accesses, with no reuse distance
+    std::vector<uint64_t> histogram;
+
+    void resize(size_t slots) {
+        slotBlocks.assign(slots, static_cast<unsigned long int>(NO_BLOCK));
+        fenwick.assign(slots + 1, 0);
+    }
+
+    void compact() {
+        std::vector<unsigned long int> live;
+        for (uint32_t s = 0; s < nextSlot; ++s) {
+            if (slotBlocks[s] != NO_BLOCK) live.push_back(slotBlocks[s]);
+        }
+        resize(live.size() * 2 + 1024);
+        nextSlot = 0;
+        for (unsigned long int block : live) {
+            add(nextSlot, 1);
+            slotBlocks[nextSlot] = block;
+            lastSlot[block] = nextSlot++;
+        }
+    }
+
+    void add(size_t pos, int delta) {
+        for (size_t i = pos + 1; i < fenwick.size(); i += i & (~i + 1)) {
+            fenwick[i] += delta;
+        }
+    }
+
+    // Sum of slots 0..pos-1
+    uint64_t prefixSum(size_t pos) const {
+        int64_t sum = 0;
+        for (size_t i = pos; i > 0; i -= i & (~i + 1)) {
+            sum += fenwick[i];
+        }
+        return static_cast<uint64_t>(sum);
+    }
+};
+
+// Fully associative LRU cache of a number of blocks
+class ShadowCache {
+public:
+    explicit ShadowCache(size_t capacity) : capacity(capacity) {}
+
+    // Access a block; true on a hit
+    bool access(unsigned long int block) {
+        auto it = where.find(block);
+        if (it != where.end()) {
+            order.splice(order.begin(), order, it->second);
+            return true;
+        }
+        if (order.size() == capacity) {
+            where.erase(order.back());
+            order.pop_back();
+        }
+        order.push_front(block);
+        where[block] = order.begin();
+        return false;
+    }
+
+private:
+    size_t capacity;
+    std::list<unsigned long int> order;  // Most recently used first
+    std::unordered_map<unsigned long int, std::list<unsigned long int>::iterator> where;
+};
+
+class CacheInstrumentation {
+public:
+    CacheInstrumentation(const HierarchyConfig& config, uint64_t window)
+        : BSizeBits(config.BSizeBits), window(window ? window : 1), accesses(0) {
+        for (const LevelConfig& level : config.levels) {
+            levels.emplace_back(level, config.BSizeBits);
+        }
+    }
+
+    // An access of the trace
+    void traceAccess(unsigned long int address) {
+        unsigned long int block = address >> BSizeBits;
+        reuse.access(block);
+        if (accesses % window == 0) windowBlocks.push_back(0);
+        auto seen = lastWindow.find(block);
+        uint64_t current = accesses / window;
+        if (seen == lastWindow.end() || seen->second != current) {
+            windowBlocks.back()++;
+            lastWindow[block] = current;
+        }
+        accesses++;
+    }
+
+    // A demand access of a level
+    void levelAccess(unsigned l, unsigned set, unsigned long int address, bool hit) {
+        Level& level = levels[l];
+        unsigned long int block = address >> BSizeBits;
+        level.setAccesses[set]++;
+        bool first = level.seen.insert(block).second;
+        bool shadowHit = level.shadow.access(block);
+        if (hit) return;
+        level.setMisses[set]++;
+        if (first) {
+            level.compulsory++;
+        } else if (!shadowHit) {
+            level.capacity++;
+        } else {
+            level.conflict++;
+        }
+    }
+
+    // Write the report, as CSV sections
+    void report(FILE* out) const {
+        fprintf(out, "# 3C misses\nlevel,accesses,misses,compulsory,capacity,conflict\n");
+        for (const Level& level : levels) {
+            uint64_t total = 0, misses = 0;
+            for (size_t s = 0; s < level.setAccesses.size(); ++s) {
+                total += level.setAccesses[s];
+                misses += level.setMisses[s];
+            }
+            fprintf(out, "%s,%llu,%llu,%llu,%llu,%llu\n", level.name.c_str(), static_cast<unsigned long long>(total),
+                    static_cast<unsigned long long>(misses), static_cast<unsigned long long>(level.compulsory),
+                    static_cast<unsigned long long>(level.capacity), static_cast<unsigned long long>(level.conflict));
+        }
+
+        fprintf(out, "\n# Reuse distance (distinct blocks between accesses of a block)\ndistance,accesses\n");
+        fprintf(out, "cold,%llu\n", static_cast<unsigned long long>(reuse.getCold()));
+        const std::vector<uint64_t>& histogram = reuse.getHistogram();
+        for (size_t b = 0; b < histogram.size(); ++b) {
+            unsigned long long low = b ? 1ull << (b - 1) : 0, high = b ? (1ull << b) - 1 : 0;
+            fprintf(out, "%llu-%llu,%llu\n", low, high, static_cast<unsigned long long>(histogram[b]));
+        }
+
+        fprintf(out, "\n# Working set (distinct blocks) per window of %llu accesses\nwindow,first-access,blocks\n",
+                static_cast<unsigned long long>(window));
+        for (size_t w = 0; w < windowBlocks.size(); ++w) {
+            fprintf(out, "%zu,%llu,%llu\n", w, static_cast<unsigned long long>(w * window),
+                    static_cast<unsigned long long>(windowBlocks[w]));
+        }
+
+        fprintf(out, "\n# Set heatmap\nlevel,set,accesses,misses\n");
+        for (const Level& level : levels) {
+            for (size_t s = 0; s < level.setAccesses.size(); ++s) {
+                fprintf(out, "%s,%zu,%llu,%llu\n", level.name.c_str(), s,
+                        static_cast<unsigned long long>(level.setAccesses[s]),
+                        static_cast<unsigned long long>(level.setMisses[s]));
+            }
+        }
+    }
+
+private:
+    struct Level {
+        Level(const LevelConfig& config, unsigned BSizeBits)
+            : name(config.name), shadow(1ul << (config.SizeBits - BSizeBits)),
+              setAccesses(1ul << (config.SizeBits - BSizeBits - config.AssocBits), 0),
+              setMisses(setAccesses.size(), 0), compulsory(0), capacity(0), conflict(0) {}
+
+        std::string name;
+        ShadowCache shadow;  // Same number of blocks, fully associative
+        std::unordered_set<unsigned long int> seen;  // Blocks accessed at this level
+        std::vector<uint64_t> setAccesses;
+        std::vector<uint64_t> setMisses;
+        uint64_t compulsory;
+        uint64_t capacity;
+        uint64_t conflict;
+    };
+
+    unsigned BSizeBits;
+    uint64_t window;    // Accesses per working-set window
+    uint64_t accesses;  // Trace accesses so far
+    std::vector<Level> levels;
+    ReuseDistance reuse;
+    std::unordered_map<unsigned long int, uint64_t> lastWindow;  // Latest window of each block
+    std::vector<uint64_t> windowBlocks;  // Distinct blocks of each window
+};
+
+#ifdef CACHE_NO_INSTRUMENT
+#define INSTRUMENT_TRACE(instr, address) do { } while (0)
+#define INSTRUMENT_LEVEL(instr, level, set, address, hit) do { } while (0)
+#else
+#define INSTRUMENT_TRACE(instr, address) \
+    do { if (instr) (instr)->traceAccess(address); } while (0)
+#define INSTRUMENT_LEVEL(instr, level, set, address, hit) \
+    do { if (instr) (instr)->levelAccess(level, set, address, hit); } while (0)
+#endif
+
+#endif
@@ -0,0 +1,397 @@
+#ifndef MULTICORE_H
+#define MULTICORE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "epochBarrier.h"
+#include "traceReader.h"
+
+// Multicore simulation: a private L1 per core, kept coherent with MESI by a
+// directory in a shared, inclusive L2. Each core runs its own trace; an
+// instruction fetch is a read of the core's L1. Both levels are write-back,
+// with the replacement policy as the template parameter.
+//
+// Cores advance in epochs. In the local phase every core runs its trace as
+// long as its accesses are L1 hits that need no coherence action (any read
+// hit, a write hit in M or E), up to `epoch` accesses; the first access that
+// needs the L2 or the directory is left pending. In the shared phase the
+// pending accesses are resolved one core at a time, in core order. Local
+// phases only touch their own core, so they can run on separate host
+// threads; the result is the same for any number of threads.
+//
+// A miss on a block that a write of another core invalidated is a coherence
+// miss; it is also a false-sharing miss when the invalidated core had never
+// touched the word that was written. Blocks are tracked by words of
+// max(4, block size / 64) bytes.
+
+enum MesiState : uint8_t {
+    MESI_I = 0,
+    MESI_S = 1,
+    MESI_E = 2,
+    MESI_M = 3
+};
+
+struct CoreStats {
+    uint64_t accesses = 0;
+    uint64_t coherenceMisses = 0;     // Misses on blocks invalidated by another core
+    uint64_t falseSharingMisses = 0;  // Of those, misses where the invalidation was false sharing
+    uint64_t upgrades = 0;            // Write hits on shared lines
+    uint64_t invalidations = 0;       // Lines invalidated by other cores' writes
+    uint64_t backInvalidations = 0;   // Lines invalidated by L2 evictions
+    uint64_t writebacks = 0;          // Modified lines written to the L2
+};
+
+template <class Replacement>
+class MulticoreSim {
+public:
+    typedef BasicCache<Replacement> Level;
+
+    // Cores get the first level of the config as their L1, the second level is the shared L2
+    MulticoreSim(const HierarchyConfig& config, unsigned numCores, unsigned epoch)
+        : l2("L2", config.BSizeBits, config.levels[1].SizeBits, config.levels[1].AssocBits, config.levels[1].Cyc,
+             config.levels[1].WrAlloc, config.levels[1].WrBack),
+          MemCyc(config.MemCyc), BSizeBits(config.BSizeBits), WrAlloc(config.levels[0].WrAlloc), epoch(epoch),
+          memoryReads(0), memoryWrites(0) {
+        const LevelConfig& l1 = config.levels[0];
+        for (unsigned c = 0; c < numCores; ++c) {
+            cores.emplace_back(Level("L1." + std::to_string(c), config.BSizeBits, l1.SizeBits, l1.AssocBits, l1.Cyc,
+                                     l1.WrAlloc, l1.WrBack));
+        }
+        sharers.assign(l2.tags.size(), 0);
+        wordShift = BSizeBits > 8 ? BSizeBits - 6 : 2;
+    }
+
+    // Run every core's trace to its end; returns 0, or the first error in core
+    // order: -1 on a trace format error, -2 on an unknown operation, which is
+    // stored in unknown
+    int run(std::vector<TraceReader>& traces, unsigned threads, char& unknown) {
+        for (size_t c = 0; c < cores.size(); ++c) {
+            cores[c].trace = &traces[c];
+        }
+        threads = std::max(1u, std::min<unsigned>(threads, cores.size()));
+        EpochBarrier barrier(threads);
+        bool stop = false;
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                while (true) {
+                    barrier.wait();  // Local phase starts
+                    if (stop) return;
+                    runLocalPhase(t, threads);
+                    barrier.wait();  // Local phase ends
+                }
+            });
+        }
+        int status = 0;
+        while (true) {
+            if (threads > 1) barrier.wait();
+            runLocalPhase(0, threads);
+            if (threads > 1) barrier.wait();
+            // Shared phase, on this thread only
+            bool active = false;
+            for (size_t c = 0; c < cores.size(); ++c) {
+                Core& core = cores[c];
+                if (core.hasPending) {
+                    resolve(c, core.pending);
+                    core.hasPending = false;
+                }
+                if (core.status < 0 && status == 0) {
+                    status = core.status;
+                    unknown = core.unknown;
+                }
+                active = active || !core.done;
+            }
+            if (!active || status < 0) break;
+        }
+        stop = true;
+        if (threads > 1) barrier.wait();
+        for (std::thread& worker : workers) worker.join();
+        return status;
+    }
+
+    size_t numCores() const { return cores.size(); }
+    const Level& l1(size_t c) const { return cores[c].l1; }
+    const CoreStats& coreStats(size_t c) const { return cores[c].stats; }
+    const Level& sharedL2() const { return l2; }
+    uint64_t getMemoryReads() const { return memoryReads; }
+    uint64_t getMemoryWrites() const { return memoryWrites; }
+
+    // Average access time of one core
+    double accessTime(size_t c) const {
+        const Level& cache = cores[c].l1;
+        return cache.getAccessTime() + cache.hitMissCalculator() * (l2.getAccessTime() + l2.hitMissCalculator() * MemCyc);
+    }
+
+    // Blocks with the most false-sharing invalidations, most first
+    std::vector<std::pair<unsigned long int, uint64_t>> hotLines(size_t num) const {
+        std::vector<std::pair<unsigned long int, uint64_t>> lines(falseSharing.begin(), falseSharing.end());
+        std::sort(lines.begin(), lines.end(), [](const std::pair<unsigned long int, uint64_t>& a,
+                                                 const std::pair<unsigned long int, uint64_t>& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+        if (lines.size() > num) lines.resize(num);
+        return lines;
+    }
+
+private:
+    struct Access {
+        char op;
+        unsigned long int address;
+    };
+
+    struct Core {
+        explicit Core(Level&& cache)
+            : l1(std::move(cache)), state(l1.tags.size(), MESI_I), touched(l1.tags.size(), 0),
+              trace(nullptr), hasPending(false), done(false), status(1), unknown(0) {}
+
+        Level l1;
+        std::vector<uint8_t> state;     // MESI state of every L1 line
+        std::vector<uint64_t> touched;  // Words of every L1 line this core accessed
+        TraceReader* trace;
+        Access pending;                 // Access waiting for the shared phase
+        bool hasPending;
+        bool done;                      // Trace fully read
+        int status;                     // Last TraceReader::next result, or -2 on an unknown operation
+        char unknown;                   // The unknown operation
+        CoreStats stats;
+        // Blocks lost to another core's write, with whether that was false sharing
+        std::unordered_map<unsigned long int, bool> lost;
+    };
+
+    std::vector<Core> cores;
+    Level l2;
+    std::vector<uint64_t> sharers;  // Directory: cores holding each L2 line
+    unsigned MemCyc;
+    unsigned BSizeBits;
+    unsigned WrAlloc;
+    unsigned epoch;
+    unsigned wordShift;  // log2 of the bytes per tracked word
+    uint64_t memoryReads;   // Blocks read from memory
+    uint64_t memoryWrites;  // Blocks written to memory
+    std::unordered_map<unsigned long int, uint64_t> falseSharing;  // Block address to false-sharing invalidations
+
+    uint64_t wordBit(unsigned long int address) const {
+        return 1ull << ((address & ((1ul << BSizeBits) - 1)) >> wordShift);
+    }
+
+    unsigned long int blockOf(unsigned long int address) const {
+        return address >> BSizeBits << BSizeBits;
+    }
+
+    // Local phase of the cores of one thread
+    void runLocalPhase(unsigned thread, unsigned threads) {
+        for (size_t c = thread; c < cores.size(); c += threads) {
+            Core& core = cores[c];
+            for (unsigned n = 0; n < epoch && !core.hasPending && !core.done; ++n) {
+                Access a;
+                core.status = core.trace->next(a.op, a.address);
+                if (core.status <= 0) {
+                    core.done = true;
+                    break;
+                }
+                if (a.op == 'i') {
+                    a.op = 'r';
+                } else if (a.op != 'r' && a.op != 'w') {
+                    core.status = -2;
+                    core.unknown = a.op;
+                    core.done = true;
+                    break;
+                }
+                core.stats.accesses++;
+                if (!localHit(core, a)) {
+                    core.pending = a;
+                    core.hasPending = true;
+                }
+            }
+        }
+    }
+
+    // An L1 hit that needs no coherence action
+    bool localHit(Core& core, const Access& a) {
+        Level& cache = core.l1;
+        unsigned index = cache.getIndex(a.address);
+        unsigned way = cache.findWay(index, cache.getTag(a.address));
+        if (way == cache.numWays) return false;
+        size_t line = static_cast<size_t>(index) * cache.numWays + way;
+        if (a.op == 'w' && core.state[line] == MESI_S) return false;
+        cache.hits++;
+        cache.touch(index, way);
+        core.touched[line] |= wordBit(a.address);
+        if (a.op == 'w') core.state[line] = MESI_M;
+        return true;
+    }
+
+    // Finish an access that needs the L2 or the directory
+    void resolve(size_t c, const Access& a) {
+        Core& core = cores[c];
+        Level& cache = core.l1;
+        bool isWrite = a.op == 'w';
+        unsigned index = cache.getIndex(a.address);
+        unsigned long int tag = cache.getTag(a.address);
+        unsigned way = cache.findWay(index, tag);
+        unsigned long int block = blockOf(a.address);
+
+        if (way != cache.numWays) {
+            // Write hit on a shared line: invalidate the other copies
+            size_t line = static_cast<size_t>(index) * cache.numWays + way;
+            cache.hits++;
+            cache.touch(index, way);
+            core.stats.upgrades++;
+            invalidateOthers(c, a.address, l2Line(a.address));
+            core.state[line] = MESI_M;
+            core.touched[line] |= wordBit(a.address);
+            return;
+        }
+
+        cache.misses++;
+        auto lost = core.lost.find(block);
+        if (lost != core.lost.end()) {
+            core.stats.coherenceMisses++;
+            core.stats.falseSharingMisses += lost->second;
+            core.lost.erase(lost);
+        }
+
+        bool allocate = !isWrite || WrAlloc;
+        long int shared = l2Access(a.address, isWrite, allocate);
+        if (!allocate) {
+            // The write is performed in the L2 (or memory); no L1 keeps a stale copy
+            if (shared >= 0) invalidateOthers(c, a.address, static_cast<size_t>(shared));
+            return;
+        }
+        size_t sharedLine = static_cast<size_t>(shared);
+        uint8_t newState;
+        if (isWrite) {
+            invalidateOthers(c, a.address, sharedLine);
+            newState = MESI_M;
+        } else if (sharers[sharedLine] & ~(1ull << c)) {
+            downgradeOthers(c, a.address, sharedLine);
+            newState = MESI_S;
+        } else {
+            newState = MESI_E;
+        }
+
+        // Fill the L1, evicting its victim
+        unsigned victim = cache.victimWay(index);
+        size_t line = static_cast<size_t>(index) * cache.numWays + victim;
+        if (cache.tags[line] & Level::VALID) {
+            unsigned long int evicted = cache.getAddress(index, cache.tags[line] & ~Level::VALID);
+            size_t evictedLine = l2Line(evicted);
+            sharers[evictedLine] &= ~(1ull << c);
+            if (core.state[line] == MESI_M) {
+                core.stats.writebacks++;
+                writeBackToL2(evictedLine);
+            }
+        }
+        cache.fill(index, victim, tag, false);
+        core.state[line] = newState;
+        core.touched[line] = wordBit(a.address);
+        sharers[sharedLine] |= 1ull << c;
+    }
+
+    // Line of a block the L2 holds (inclusion guarantees it for blocks in an L1)
+    size_t l2Line(unsigned long int address) const {
+        unsigned index = l2.getIndex(address);
+        return static_cast<size_t>(index) * l2.numWays + l2.findWay(index, l2.getTag(address));
+    }
+
+    // Demand access of the shared L2; returns the line holding the block, or -1 when it is not allocated
+    long int l2Access(unsigned long int address, bool isWrite, bool aboveAllocates) {
+        unsigned index = l2.getIndex(address);
+        unsigned long int tag = l2.getTag(address);
+        unsigned way = l2.findWay(index, tag);
+        if (way != l2.numWays) {
+            l2.hits++;
+            l2.touch(index, way);
+            size_t line = static_cast<size_t>(index) * l2.numWays + way;
+            if (isWrite && !aboveAllocates) l2.dirty[line] = 1;
+            return static_cast<long int>(line);
+        }
+        l2.misses++;
+        if (!aboveAllocates && !l2.WrAlloc) {
+            memoryWrites++;  // Written around both levels
+            return -1;
+        }
+        memoryReads++;
+        way = l2.victimWay(index);
+        size_t line = static_cast<size_t>(index) * l2.numWays + way;
+        if (l2.tags[line] & Level::VALID) {
+            // Inclusion: the L1 copies go too, modified data to memory
+            unsigned long int evicted = l2.getAddress(index, l2.tags[line] & ~Level::VALID);
+            bool dirty = l2.dirty[line];
+            for (size_t d = 0; d < cores.size(); ++d) {
+                if (!(sharers[line] & (1ull << d))) continue;
+                Core& other = cores[d];
+                unsigned otherIndex = other.l1.getIndex(evicted);
+                unsigned otherWay = other.l1.findWay(otherIndex, other.l1.getTag(evicted));
+                if (otherWay == other.l1.numWays) continue;
+                size_t otherLine = static_cast<size_t>(otherIndex) * other.l1.numWays + otherWay;
+                if (other.state[otherLine] == MESI_M) {
+                    other.stats.writebacks++;
+                    dirty = true;
+                }
+                other.stats.backInvalidations++;
+                other.state[otherLine] = MESI_I;
+                other.l1.invalidate(otherIndex, otherWay);
+            }
+            if (dirty) memoryWrites++;
+        }
+        l2.fill(index, way, tag, isWrite && !aboveAllocates);
+        sharers[line] = 0;
+        return static_cast<long int>(line);
+    }
+
+    // A modified L1 copy goes back to the L2
+    void writeBackToL2(size_t line) {
+        l2.dirty[line] = 1;
+        l2.touch(static_cast<unsigned>(line / l2.numWays), static_cast<unsigned>(line % l2.numWays));
+    }
+
+    // Invalidate every other core's copy of a block before core c writes it
+    void invalidateOthers(size_t c, unsigned long int address, size_t sharedLine) {
+        uint64_t written = wordBit(address);
+        unsigned long int block = blockOf(address);
+        for (size_t d = 0; d < cores.size(); ++d) {
+            if (d == c || !(sharers[sharedLine] & (1ull << d))) continue;
+            Core& other = cores[d];
+            unsigned index = other.l1.getIndex(address);
+            unsigned way = other.l1.findWay(index, other.l1.getTag(address));
+            if (way == other.l1.numWays) continue;
+            size_t line = static_cast<size_t>(index) * other.l1.numWays + way;
+            if (other.state[line] == MESI_M) {
+                other.stats.writebacks++;
+                writeBackToL2(sharedLine);
+            }
+            bool isFalse = !(other.touched[line] & written);
+            if (isFalse) falseSharing[block]++;
+            other.lost[block] = isFalse;
+            other.stats.invalidations++;
+            other.state[line] = MESI_I;
+            other.l1.invalidate(index, way);
+        }
+        sharers[sharedLine] &= 1ull << c;
+    }
+
+    // Other cores keep shared copies of a block core c reads
+    void downgradeOthers(size_t c, unsigned long int address, size_t sharedLine) {
+        for (size_t d = 0; d < cores.size(); ++d) {
+            if (d == c || !(sharers[sharedLine] & (1ull << d))) continue;
+            Core& other = cores[d];
+            unsigned index = other.l1.getIndex(address);
+            unsigned way = other.l1.findWay(index, other.l1.getTag(address));
+            if (way == other.l1.numWays) continue;
+            size_t line = static_cast<size_t>(index) * other.l1.numWays + way;
+            if (other.state[line] == MESI_M) {
+                other.stats.writebacks++;
+                writeBackToL2(sharedLine);
+            }
+            other.state[line] = MESI_S;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <cstdint>
+#include <vector>
+#include "cacheConfig.h"
+
+// Hardware prefetchers of a cache level.
+// A prefetcher watches the demand accesses of its level and proposes blocks
+// to bring in. Its triggers are demand misses and first hits on prefetched
+// lines; the stride prefetcher also follows hits, to keep its streams going.
+// Every kind lives in the same class and is chosen by a switch, so levels
+// hold their prefetcher by value like the rest of their state.
+//
+//   next-line    the degree blocks after the trigger
+//   stride       streams detected per 4KB region (no PC in the trace): once a
+//                region has seen the same block delta twice in a row, the
+//                degree blocks further along that delta
+//   best-offset  delta correlation after Michaud's best-offset prefetcher:
+//                candidate offsets are scored by whether they would have
+//                predicted each trigger from an earlier one; the best offset
+//                of each learning phase is used until the next phase ends
+
+struct PrefetchStats {
+    uint64_t issued = 0;  // Blocks brought in by prefetches
+    uint64_t useful = 0;  // Prefetched blocks later hit by a demand access
+    uint64_t late = 0;    // Useful prefetches hit before their fill would have completed
+    uint64_t lateCycles = 0;  // Fill cycles the late hits still waited for
+};
+
+class Prefetcher {
+public:
+    Prefetcher(PrefetchKind kind, unsigned degree, unsigned BSizeBits)
+        : kind(kind), degree(degree ? degree : 1), BSizeBits(BSizeBits), streamClock(0), recent(RECENT_SIZE, 0),
+          scores(NUM_OFFSETS, 0), testIndex(0), round(0), bestOffset(1), active(true) {
+        streams.resize(NUM_STREAMS);
+    }
+
+    bool enabled() const { return kind != PREFETCH_NONE; }
+
+    // Observe a demand access; trigger is set for misses and first hits on
+    // prefetched lines. Appends the addresses of the blocks to prefetch.
+    void access(unsigned long int address, bool trigger, std::vector<unsigned long int>& out) {
+        long int block = static_cast<long int>(address >> BSizeBits);
+        switch (kind) {
+        case PREFETCH_NEXT_LINE:
+            if (trigger) propose(block, 1, out);
+            break;
+        case PREFETCH_STRIDE:
+            stride(block, out);
+            break;
+        case PREFETCH_BEST_OFFSET:
+            if (trigger) bestOffsetAccess(block, out);
+            break;
+        default:
+            break;
+        }
+    }
+
+    PrefetchStats stats;
+
+private:
+    static const unsigned NUM_STREAMS = 16;
+    static const unsigned REGION_BITS = 12;
+    static const unsigned RECENT_SIZE = 256;  // Recent-requests table entries (power of two)
+    static const unsigned NUM_OFFSETS = 20;
+    static const unsigned SCORE_MAX = 31;     // A phase ends when an offset reaches this score...
+    static const unsigned ROUND_MAX = 100;    // ...or after this many rounds over the offsets
+    static const unsigned BAD_SCORE = 1;      // Prefetching stops while the best score is this low
+
+    struct Stream {
+        unsigned long int region = 0;
+        long int last = 0;      // Last block accessed
+        long int delta = 0;     // Last block delta
+        unsigned confidence = 0;
+        uint64_t used = 0;      // For LRU replacement of streams
+        bool valid = false;
+    };
+
+    PrefetchKind kind;
+    unsigned degree;
+    unsigned BSizeBits;
+    std::vector<Stream> streams;
+    uint64_t streamClock;
+    std::vector<long int> recent;  // Recent trigger blocks, direct mapped
+    std::vector<unsigned> scores;
+    unsigned testIndex;  // Offset tested by the next trigger
+    unsigned round;
+    long int bestOffset;
+    bool active;         // False while no offset scores above BAD_SCORE
+
+    static long int offset(unsigned i) {
+        static const long int offsets[NUM_OFFSETS] = { 1, 2, 3, 4, 5, 6, 8, 10, 12, 15, 16, 20, 24, 30, 32,
+                                                        -1, -2, -4, -8, -16 };
+        return offsets[i];
+    }
+
+    // Blocks at delta, 2 * delta, ... up to the degree
+    void propose(long int block, long int delta, std::vector<unsigned long int>& out) const {
+        for (unsigned k = 1; k <= degree; ++k) {
+            long int target = block + delta * static_cast<long int>(k);
+            if (target >= 0) out.push_back(static_cast<unsigned long int>(target) << BSizeBits);
+        }
+    }
+
+    void stride(long int block, std::vector<unsigned long int>& out) {
+        unsigned long int region = static_cast<unsigned long int>(block) >> (REGION_BITS > BSizeBits ? REGION_BITS - BSizeBits : 0);
+        streamClock++;
+        Stream* stream = &streams[0];
+        for (Stream& s : streams) {
+            if (s.valid && s.region == region) {
+                stream = &s;
+                break;
+            }
+            if (!s.valid || s.used < stream->used) stream = &s;
+        }
+        if (!stream->valid || stream->region != region) {
+            *stream = Stream();
+            stream->valid = true;
+            stream->region = region;
+            stream->last = block;
+            stream->used = streamClock;
+            return;
+        }
+        stream->used = streamClock;
+        long int delta = block - stream->last;
+        if (delta == 0) return;
+        if (delta == stream->delta) {
+            if (stream->confidence < 3) stream->confidence++;
+        } else {
+            stream->delta = delta;
+            stream->confidence = 0;
+        }
+        stream->last = block;
+        if (stream->confidence >= 1) propose(block, delta, out);
+    }
+
+    void bestOffsetAccess(long int block, std::vector<unsigned long int>& out) {
+        // Learning: would the tested offset have predicted this block?
+        long int base = block - offset(testIndex);
+        if (base >= 0 && recent[static_cast<unsigned long int>(base) & (RECENT_SIZE - 1)] == base) {
+            scores[testIndex]++;
+        }
+        bool phaseDone = scores[testIndex] >= SCORE_MAX;
+        if (++testIndex == NUM_OFFSETS) {
+            testIndex = 0;
+            phaseDone = phaseDone || ++round >= ROUND_MAX;
+        }
+        if (phaseDone) {
+            unsigned best = 0;
+            for (unsigned i = 1; i < NUM_OFFSETS; ++i) {
+                if (scores[i] > scores[best]) best = i;
+            }
+            active = scores[best] > BAD_SCORE;
+            bestOffset = offset(best);
+            scores.assign(NUM_OFFSETS, 0);
+            testIndex = 0;
+            round = 0;
+        }
+        recent[static_cast<unsigned long int>(block) & (RECENT_SIZE - 1)] = block;
+        if (active) propose(block, bestOffset, out);
+    }
+};
+
+#endif
@@ -0,0 +1,250 @@
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+#include <cstdint>
+#include <vector>
+#include "cacheAddress.h"
+
+// Replacement policies of a cache level, used as its template parameter so
+// that every call inlines. A policy keeps its own state for all sets and is
+// told about the events of the level's lines:
+//   init(numSets, numWays)  once, before any access
+//   hit(index, way)         a line was accessed (or written back into)
+//   fill(index, way)        a block was placed in a way
+//   remove(index, way)      a line was invalidated
+//   victim(index, tags)     the way to replace in a set; tags are the set's
+//                           stored tags, with VALID_TAG set on valid lines
+// PER_SET tells whether all of a policy's state is per set, so that sets
+// can be simulated apart (see shardedSim.h).
+// numWays is always a power of two. Except for LRU, whose ages already put
+// invalid lines last, the policies replace an invalid line when the set has
+// one.
+
+// First invalid way of a set, or numWays when all are valid
+inline unsigned invalidWay(const unsigned long int* tags, unsigned numWays) {
+    unsigned way = numWays;
+    for (unsigned w = numWays; w-- > 0;) {
+        way = tags[w] & VALID_TAG ? way : w;
+    }
+    return way;
+}
+
+// True LRU, kept as an age per line: within a set the ages are a permutation
+// of 0..numWays-1, with 0 the most recently used line. Invalid lines always
+// hold the oldest ages, so the victim of a set is simply its oldest line.
+class LruReplacement {
+public:
+    static const bool PER_SET = true;
+
+    void init(unsigned numSets, unsigned ways) {
+        numWays = ways;
+        ages.resize(static_cast<size_t>(numSets) * numWays);
+        for (size_t i = 0; i < ages.size(); ++i) {
+            ages[i] = static_cast<uint16_t>(i & (numWays - 1));
+        }
+    }
+
+    void hit(unsigned index, unsigned way) { promote(index, way); }
+    void fill(unsigned index, unsigned way) { promote(index, way); }
+
+    // An invalidated line becomes the oldest of its set
+    void remove(unsigned index, unsigned way) {
+        uint16_t* age = &ages[static_cast<size_t>(index) * numWays];
+        uint16_t old = age[way];
+        for (unsigned w = 0; w < numWays; ++w) {
+            age[w] -= age[w] > old;
+        }
+        age[way] = static_cast<uint16_t>(numWays - 1);
+    }
+
+    unsigned victim(unsigned index, const unsigned long int*) const {
+        const uint16_t* age = &ages[static_cast<size_t>(index) * numWays];
+        unsigned way = 0;
+        for (unsigned w = 0; w < numWays; ++w) {
+            way = age[w] == numWays - 1 ? w : way;
+        }
+        return way;
+    }
+
+protected:
+    unsigned numWays = 0;
+    std::vector<uint16_t> ages;  // LRU age of every line
+
+    // Make a line the most recently used of its set
+    void promote(unsigned index, unsigned way) {
+        uint16_t* age = &ages[static_cast<size_t>(index) * numWays];
+        uint16_t old = age[way];
+        for (unsigned w = 0; w < numWays; ++w) {
+            age[w] += age[w] < old;
+        }
+        age[way] = 0;
+    }
+};
+
+// FIFO: the LRU ages, moved only when a block is placed
+class FifoReplacement : public LruReplacement {
+public:
+    void hit(unsigned, unsigned) {}
+};
+
+// Tree pseudo-LRU: numWays - 1 bits per set, one per node of a binary tree
+// over the ways, each pointing to the half that holds the next victim
+class PlruReplacement {
+public:
+    static const bool PER_SET = true;
+
+    void init(unsigned numSets, unsigned ways) {
+        numWays = ways;
+        depth = 0;
+        while ((1u << depth) < numWays) depth++;
+        words = (numWays + 63) / 64;
+        bits.assign(static_cast<size_t>(numSets) * words, 0);
+    }
+
+    void hit(unsigned index, unsigned way) { pointAway(index, way); }
+    void fill(unsigned index, unsigned way) { pointAway(index, way); }
+    void remove(unsigned, unsigned) {}
+
+    unsigned victim(unsigned index, const unsigned long int* tags) const {
+        unsigned way = invalidWay(tags, numWays);
+        if (way != numWays) return way;
+        const uint64_t* tree = &bits[static_cast<size_t>(index) * words];
+        unsigned node = 1;
+        way = 0;
+        for (unsigned d = 0; d < depth; ++d) {
+            unsigned bit = (tree[node >> 6] >> (node & 63)) & 1;
+            way = (way << 1) | bit;
+            node = 2 * node + bit;
+        }
+        return way;
+    }
+
+private:
+    unsigned numWays = 0;
+    unsigned depth = 0;  // log2(numWays)
+    unsigned words = 0;  // Words of tree bits per set
+    std::vector<uint64_t> bits;  // Node n of a set's tree is bit n
+
+    // Turn every node on the path to a way towards the other half
+    void pointAway(unsigned index, unsigned way) {
+        uint64_t* tree = &bits[static_cast<size_t>(index) * words];
+        unsigned node = 1;
+        for (unsigned d = 0; d < depth; ++d) {
+            unsigned bit = (way >> (depth - 1 - d)) & 1;
+            uint64_t mask = 1ull << (node & 63);
+            tree[node >> 6] = bit ? tree[node >> 6] & ~mask : tree[node >> 6] | mask;
+            node = 2 * node + bit;
+        }
+    }
+};
+
+// Re-reference interval prediction (Jaleel et al.), with 2-bit RRPVs per line.
+// A hit predicts a near re-reference (0); the victim is a line predicted
+// distant (3), after ageing the set until one is. The insertion prediction
+// selects the variant:
+//   RRIP_STATIC   SRRIP: long (2)
+//   RRIP_BIMODAL  BRRIP: distant, long for one fill in 32
+//   RRIP_DYNAMIC  DRRIP: set dueling between the two. Sets 0 and 1 of every 32
+//                 always use SRRIP and BRRIP; their misses move a 10-bit
+//                 counter that chooses the insertion of all other sets.
+enum RripInsertion {
+    RRIP_STATIC,
+    RRIP_BIMODAL,
+    RRIP_DYNAMIC
+};
+
+template <RripInsertion Insertion>
+class RripReplacement {
+public:
+    // BRRIP's one-in-32 count and DRRIP's dueling counter span all sets
+    static const bool PER_SET = Insertion == RRIP_STATIC;
+
+    void init(unsigned numSets, unsigned ways) {
+        numWays = ways;
+        rrpv.assign(static_cast<size_t>(numSets) * numWays, static_cast<uint8_t>(DISTANT));
+        psel = PSEL_MAX / 2;
+        fills = 0;
+    }
+
+    void hit(unsigned index, unsigned way) {
+        rrpv[static_cast<size_t>(index) * numWays + way] = 0;
+    }
+
+    // A fill follows a miss of the set, which is what the dueling sets count
+    void fill(unsigned index, unsigned way) {
+        bool bimodal = Insertion == RRIP_BIMODAL;
+        if (Insertion == RRIP_DYNAMIC) {
+            unsigned leader = index & 31;
+            if (leader == 0) {
+                psel += psel < PSEL_MAX;
+            } else if (leader == 1) {
+                psel -= psel > 0;
+            }
+            bimodal = leader == 1 || (leader != 0 && psel > PSEL_MAX / 2);
+        }
+        uint8_t prediction = DISTANT - 1;
+        if (bimodal && (++fills & 31) != 0) prediction = DISTANT;
+        rrpv[static_cast<size_t>(index) * numWays + way] = prediction;
+    }
+
+    void remove(unsigned index, unsigned way) {
+        rrpv[static_cast<size_t>(index) * numWays + way] = DISTANT;
+    }
+
+    unsigned victim(unsigned index, const unsigned long int* tags) {
+        unsigned way = invalidWay(tags, numWays);
+        if (way != numWays) return way;
+        uint8_t* set = &rrpv[static_cast<size_t>(index) * numWays];
+        uint8_t oldest = 0;
+        for (unsigned w = 0; w < numWays; ++w) {
+            oldest = set[w] > oldest ? set[w] : oldest;
+        }
+        uint8_t age = DISTANT - oldest;
+        way = 0;
+        for (unsigned w = numWays; w-- > 0;) {
+            set[w] += age;
+            way = set[w] == DISTANT ? w : way;
+        }
+        return way;
+    }
+
+private:
+    static const uint8_t DISTANT = 3;
+    static const unsigned PSEL_MAX = 1023;
+
+    unsigned numWays = 0;
+    std::vector<uint8_t> rrpv;  // Re-reference prediction of every line
+    unsigned psel = 0;          // Set dueling counter, high when SRRIP misses more
+    unsigned fills = 0;         // For the one-in-32 long insertions of BRRIP
+};
+
+// Random replacement, from a fixed seed so that runs repeat
+class RandomReplacement {
+public:
+    static const bool PER_SET = false;
+
+    void init(unsigned, unsigned ways) {
+        numWays = ways;
+        state = 0x9e3779b97f4a7c15ull;
+    }
+
+    void hit(unsigned, unsigned) {}
+    void fill(unsigned, unsigned) {}
+    void remove(unsigned, unsigned) {}
+
+    unsigned victim(unsigned, const unsigned long int* tags) {
+        unsigned way = invalidWay(tags, numWays);
+        if (way != numWays) return way;
+        // xorshift64
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return static_cast<unsigned>(state >> 32) & (numWays - 1);
+    }
+
+private:
+    unsigned numWays = 0;
+    uint64_t state = 0;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef SHARDED_SIM_H
+#define SHARDED_SIM_H
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "epochBarrier.h"
+#include "traceReader.h"
+
+// Parallel simulation of one hierarchy, sharded by set.
+// All levels share the block size, so the lowest k set-index bits of a block
+// are the same in every level; when every level has at least 2^k sets, the
+// blocks of one value of those bits only ever meet blocks of the same value,
+// through hits, evictions, write-backs, victims and back-invalidations alike.
+// Each of the 2^k shards is then simulated apart, in a hierarchy with 2^k
+// times fewer sets per level, on addresses with the k bits taken out. The
+// counts of all shards add up to those of the sequential run, provided the
+// replacement state is per set (Replacement::PER_SET) and nothing else spans
+// sets (prefetchers and tracing do).
+// The trace is decoded in chunks into one queue per shard, and the shards of
+// a chunk are spread over the threads, which live for the whole run and meet
+// at a barrier before and after every chunk.
+
+template <class Replacement>
+class ShardedSim {
+public:
+    // Largest k for a config: every level keeps at least one set per shard
+    static unsigned maxShardBits(const HierarchyConfig& config) {
+        unsigned bits = 64;
+        for (const LevelConfig& level : config.levels) {
+            unsigned setBits = level.SizeBits - config.BSizeBits - level.AssocBits;
+            bits = setBits < bits ? setBits : bits;
+        }
+        return bits;
+    }
+
+    ShardedSim(const HierarchyConfig& config, unsigned shardBits)
+        : BSizeBits(config.BSizeBits), shardBits(shardBits), queues(1u << shardBits) {
+        HierarchyConfig slice = config;
+        for (LevelConfig& level : slice.levels) {
+            level.SizeBits -= shardBits;
+        }
+        for (size_t s = 0; s < queues.size(); ++s) {
+            shards.emplace_back(slice);
+        }
+    }
+
+    // Simulate a whole trace; returns the last TraceReader::next result
+    // (0 at the end, -1 on a format error), or -2 on an unknown operation,
+    // which is stored in unknown
+    int run(TraceReader& trace, unsigned threads, char& unknown) {
+        const size_t CHUNK = 1 << 20;
+        unsigned long int blockMask = (1ul << BSizeBits) - 1;
+        unsigned long int shardMask = (1ul << shardBits) - 1;
+        if (threads > queues.size()) threads = static_cast<unsigned>(queues.size());
+        if (threads == 0) threads = 1;
+        EpochBarrier barrier(threads);
+        bool stop = false;
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < threads; ++t) {
+            workers.emplace_back([this, t, threads, &barrier, &stop] {
+                while (true) {
+                    barrier.wait();  // Chunk decoded
+                    if (stop) return;
+                    runShards(t, threads);
+                    barrier.wait();  // Chunk simulated
+                }
+            });
+        }
+
+        int status;
+        do {
+            for (std::vector<ShardAccess>& queue : queues) queue.clear();
+            char operation = 0;
+            unsigned long int address = 0;
+            for (size_t n = 0; n < CHUNK && (status = trace.next(operation, address)) > 0; ++n) {
+                if (operation != 'r' && operation != 'w' && operation != 'i') {
+                    unknown = operation;
+                    status = -2;
+                    break;
+                }
+                ShardAccess access;
+                access.address = (address >> (BSizeBits + shardBits) << BSizeBits) | (address & blockMask);
+                access.op = operation;
+                queues[(address >> BSizeBits) & shardMask].push_back(access);
+            }
+            if (status == -2) break;
+
+            if (threads > 1) barrier.wait();
+            runShards(0, threads);
+            if (threads > 1) barrier.wait();
+        } while (status > 0);
+
+        stop = true;
+        if (threads > 1) barrier.wait();
+        for (std::thread& worker : workers) worker.join();
+        return status;
+    }
+
+    // The counts of all shards, gathered in the hierarchy of the first
+    const BasicHierarchy<Replacement>& result() {
+        for (size_t s = 1; s < shards.size(); ++s) {
+            shards[0].merge(shards[s]);
+        }
+        shards.erase(shards.begin() + 1, shards.end());
+        return shards[0];
+    }
+
+private:
+    struct ShardAccess {
+        unsigned long int address;  // In the shard, without the shard bits
+        char op;
+    };
+
+    unsigned BSizeBits;
+    unsigned shardBits;
+    std::vector<BasicHierarchy<Replacement>> shards;
+    std::vector<std::vector<ShardAccess>> queues;  // Accesses of the current chunk, per shard
+
+    void runShards(unsigned thread, unsigned threads) {
+        for (size_t s = thread; s < shards.size(); s += threads) {
+            BasicHierarchy<Replacement>& caches = shards[s];
+            for (const ShardAccess& access : queues[s]) {
+                if (access.op == 'r') {
+                    caches.read(access.address);
+                } else if (access.op == 'w') {
+                    caches.write(access.address);
+                } else {
+                    caches.fetch(access.address);
+                }
+            }
+        }
+    }
+};
+
+#endif
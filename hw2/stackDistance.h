@@ -0,0 +1,125 @@
+#ifndef STACK_DISTANCE_H
+#define STACK_DISTANCE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include "cacheAddress.h"
+
+// Mattson stack-distance analysis: LRU miss rates of every cache size and
+// associativity from one read of the trace.
+// An access hits a set-associative LRU cache of W ways exactly when fewer than
+// W other blocks of its set were touched since its previous access (its stack
+// distance). The accesses are recorded once; then, for each number of sets,
+// the trace is stably grouped by set index and walked with a Fenwick tree over
+// positions that holds a 1 at the latest access of every block, so each stack
+// distance is one prefix-sum query, O(log n) per access.
+// The model is a single LRU level that allocates on every access (write
+// allocate), without back-invalidation from a lower level.
+class StackDistance {
+public:
+    StackDistance(unsigned BSizeBits, unsigned maxSetBits, unsigned maxAssocBits)
+        : BSizeBits(BSizeBits), maxSetBits(maxSetBits), maxAssocBits(maxAssocBits), cold(0) {}
+
+    // Record one access of the trace
+    void access(unsigned long int address) {
+        unsigned long int block = address >> BSizeBits;
+        auto it = blockIds.find(block);
+        uint32_t id;
+        if (it == blockIds.end()) {
+            id = static_cast<uint32_t>(blockAddresses.size());
+            blockIds.emplace(block, id);
+            blockAddresses.push_back(block << BSizeBits);
+        } else {
+            id = it->second;
+        }
+        trace.push_back(id);
+    }
+
+    // Build the stack-distance histograms of every set count
+    void analyze() {
+        size_t n = trace.size();
+        unsigned maxWays = 1u << maxAssocBits;
+        histograms.assign(maxSetBits + 1, std::vector<uint64_t>(maxWays + 1, 0));
+        cold = blockAddresses.size();
+
+        std::vector<uint32_t> order(n);
+        std::vector<uint32_t> fenwick(n + 1);
+        std::vector<int64_t> last(blockAddresses.size());
+        for (unsigned setBits = 0; setBits <= maxSetBits; ++setBits) {
+            unsigned numSets = 1u << setBits;
+            // Counting sort of the access positions by set, keeping trace order
+            std::vector<size_t> start(numSets + 1, 0);
+            for (size_t i = 0; i < n; ++i) {
+                start[blockIndex(blockAddresses[trace[i]], BSizeBits, numSets) + 1]++;
+            }
+            for (unsigned s = 0; s < numSets; ++s) {
+                start[s + 1] += start[s];
+            }
+            for (size_t i = 0; i < n; ++i) {
+                order[start[blockIndex(blockAddresses[trace[i]], BSizeBits, numSets)]++] = trace[i];
+            }
+
+            std::fill(fenwick.begin(), fenwick.end(), 0);
+            std::fill(last.begin(), last.end(), -1);
+            std::vector<uint64_t>& histogram = histograms[setBits];
+            for (size_t p = 0; p < n; ++p) {
+                uint32_t id = order[p];
+                if (last[id] >= 0) {
+                    // Blocks touched after the previous access, all in this set
+                    size_t previous = static_cast<size_t>(last[id]);
+                    uint64_t distance = prefixSum(fenwick, p) - prefixSum(fenwick, previous + 1);
+                    histogram[distance < maxWays ? distance : maxWays]++;
+                    add(fenwick, previous, -1);
+                }
+                add(fenwick, p, 1);
+                last[id] = static_cast<int64_t>(p);
+            }
+        }
+    }
+
+    // Miss rate of an LRU cache of 2^setBits sets and 2^assocBits ways
+    double missRate(unsigned setBits, unsigned assocBits) const {
+        if (trace.empty()) return 0.0;
+        const std::vector<uint64_t>& histogram = histograms[setBits];
+        uint64_t misses = cold;
+        for (size_t d = 1u << assocBits; d < histogram.size(); ++d) {
+            misses += histogram[d];
+        }
+        return static_cast<double>(misses) / trace.size();
+    }
+
+    size_t accesses() const { return trace.size(); }
+    size_t blocks() const { return blockAddresses.size(); }
+
+private:
+    unsigned BSizeBits;
+    unsigned maxSetBits;
+    unsigned maxAssocBits;
+    uint64_t cold;  // First accesses of each block, a miss at any size
+
+    std::unordered_map<unsigned long int, uint32_t> blockIds;  // Block number to dense id
+    std::vector<unsigned long int> blockAddresses;  // First address of each block, by id
+    std::vector<uint32_t> trace;  // Block id of every access
+    // Per set count: accesses by stack distance, the last bucket is maxWays or more
+    std::vector<std::vector<uint64_t>> histograms;
+
+    // Fenwick tree over positions 0..n-1
+    static void add(std::vector<uint32_t>& tree, size_t pos, int delta) {
+        for (size_t i = pos + 1; i < tree.size(); i += i & (~i + 1)) {
+            tree[i] += delta;
+        }
+    }
+
+    // Sum of positions 0..pos-1
+    static uint64_t prefixSum(const std::vector<uint32_t>& tree, size_t pos) {
+        uint64_t sum = 0;
+        for (size_t i = pos; i > 0; i -= i & (~i + 1)) {
+            sum += tree[i];
+        }
+        return sum;
+    }
+};
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "traceReader.h"
+
+// Design-space sweep: many two-level configurations over one trace.
+// The trace is decoded once into a read-only buffer that all runs share;
+// every configuration is an independent task with its own hierarchy, run
+// by a work-stealing thread pool. Results come out in task order, so they
+// do not depend on the number of threads.
+//
+// A sweep file lists the configurations, one line per group, with the
+// command-line parameters and comma-separated values for each; a line
+// stands for every combination of its values:
+//
+//   # comment
+//   --mem-cyc 100 --bsize 5,6 --l1-size 12,13,14 --l1-assoc 0,1,2 --l1-cyc 1
+//       --l2-size 16 --l2-assoc 2,4 --l2-cyc 10 --wr-alloc 0,1 --replacement lru,plru
+//
+// (all on one line). --wr-back defaults to 1 and --replacement to lru; the
+// other parameters are required. Combinations that do not make a valid
+// hierarchy are skipped.
+
+enum SweepParam {
+    SWEEP_MEM_CYC,
+    SWEEP_BSIZE,
+    SWEEP_L1_SIZE,
+    SWEEP_L1_ASSOC,
+    SWEEP_L1_CYC,
+    SWEEP_L2_SIZE,
+    SWEEP_L2_ASSOC,
+    SWEEP_L2_CYC,
+    SWEEP_WR_ALLOC,
+    SWEEP_WR_BACK,
+    SWEEP_REPLACEMENT,
+    NUM_SWEEP_PARAMS
+};
+
+inline const char* sweepParamName(unsigned param) {
+    static const char* names[NUM_SWEEP_PARAMS] = { "mem-cyc", "bsize", "l1-size", "l1-assoc", "l1-cyc", "l2-size",
+                                                   "l2-assoc", "l2-cyc", "wr-alloc", "wr-back", "replacement" };
+    return names[param];
+}
+
+// One configuration of a sweep (replacement as a ReplacementPolicy)
+struct SweepPoint {
+    unsigned values[NUM_SWEEP_PARAMS];
+
+    HierarchyConfig config() const {
+        HierarchyConfig config = HierarchyConfig::twoLevel(
+            values[SWEEP_MEM_CYC], values[SWEEP_BSIZE], values[SWEEP_L1_SIZE], values[SWEEP_L1_ASSOC],
+            values[SWEEP_L1_CYC], values[SWEEP_L2_SIZE], values[SWEEP_L2_ASSOC], values[SWEEP_L2_CYC],
+            values[SWEEP_WR_ALLOC]);
+        for (LevelConfig& level : config.levels) {
+            level.WrBack = values[SWEEP_WR_BACK];
+        }
+        config.replacement = static_cast<ReplacementPolicy>(values[SWEEP_REPLACEMENT]);
+        return config;
+    }
+};
+
+struct SweepResult {
+    double L1MissRate = 0;
+    double L2MissRate = 0;
+    double avgAccTime = 0;
+};
+
+// Read a sweep file into its configurations; returns an error message, empty on success
+inline std::string loadSweep(const char* path, std::vector<SweepPoint>& points, size_t& skipped) {
+    std::ifstream file(path);
+    if (!file) return std::string("cannot open ") + path;
+    std::string line;
+    unsigned lineNumber = 0;
+    skipped = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        std::string where = "line " + std::to_string(lineNumber) + ": ";
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+        std::istringstream words(line);
+        std::vector<std::vector<unsigned>> values(NUM_SWEEP_PARAMS);
+        values[SWEEP_WR_BACK].push_back(1);
+        values[SWEEP_REPLACEMENT].push_back(REPLACE_LRU);
+        std::string option, list;
+        bool empty = true;
+        while (words >> option) {
+            empty = false;
+            unsigned param = 0;
+            while (param < NUM_SWEEP_PARAMS && option != std::string("--") + sweepParamName(param)) param++;
+            if (param == NUM_SWEEP_PARAMS) return where + "unknown parameter " + option;
+            if (!(words >> list)) return where + "missing values of " + option;
+            values[param].clear();
+            std::istringstream items(list);
+            std::string item;
+            while (std::getline(items, item, ',')) {
+                if (param == SWEEP_REPLACEMENT) {
+                    ReplacementPolicy policy;
+                    if (!parseReplacementPolicy(item, policy)) return where + "unknown replacement policy " + item;
+                    values[param].push_back(policy);
+                } else if (!item.empty()) {
+                    values[param].push_back(static_cast<unsigned>(atoi(item.c_str())));
+                }
+            }
+        }
+        if (empty) continue;
+        for (unsigned param = 0; param < NUM_SWEEP_PARAMS; ++param) {
+            if (values[param].empty()) return where + "missing --" + sweepParamName(param);
+        }
+
+        // Every combination, the last parameter varying fastest
+        std::vector<size_t> choice(NUM_SWEEP_PARAMS, 0);
+        while (true) {
+            SweepPoint point;
+            for (unsigned param = 0; param < NUM_SWEEP_PARAMS; ++param) {
+                point.values[param] = values[param][choice[param]];
+            }
+            if (point.config().validate().empty()) {
+                points.push_back(point);
+            } else {
+                skipped++;
+            }
+            int param = NUM_SWEEP_PARAMS - 1;
+            while (param >= 0 && ++choice[param] == values[param].size()) {
+                choice[param] = 0;
+                param--;
+            }
+            if (param < 0) break;
+        }
+    }
+    return "";
+}
+
+// Runs tasks 0..n-1 on a number of threads. Each thread starts with a
+// contiguous share of the tasks in its own deque and takes them from the
+// back; a thread whose deque is empty steals from the front of the others.
+class WorkStealingPool {
+public:
+    void run(size_t numTasks, unsigned threads, const std::function<void(size_t)>& task) {
+        if (threads == 0) threads = 1;
+        std::vector<Queue> fresh(threads);
+        queues.swap(fresh);
+        for (unsigned t = 0; t < threads; ++t) {
+            for (size_t i = numTasks * t / threads; i < numTasks * (t + 1) / threads; ++i) {
+                queues[t].tasks.push_back(i);
+            }
+        }
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < threads; ++t) {
+            workers.emplace_back([this, t, &task] { work(t, task); });
+        }
+        work(0, task);
+        for (std::thread& worker : workers) worker.join();
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<Queue> queues;
+
+    void work(unsigned self, const std::function<void(size_t)>& task) {
+        size_t next;
+        while (take(self, next)) task(next);
+    }
+
+    bool take(unsigned self, size_t& next) {
+        {
+            Queue& own = queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                next = own.tasks.back();
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues.size(); ++k) {
+            Queue& victim = queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                next = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// A decoded trace access
+struct SweepAccess {
+    unsigned long int address;
+    char op;
+};
+
+// Run one configuration over the decoded trace
+template <class Replacement>
+SweepResult sweepRun(const HierarchyConfig& config, const std::vector<SweepAccess>& accesses) {
+    BasicHierarchy<Replacement> caches(config);
+    for (const SweepAccess& access : accesses) {
+        if (access.op == 'r') {
+            caches.read(access.address);
+        } else if (access.op == 'w') {
+            caches.write(access.address);
+        } else {
+            caches.fetch(access.address);
+        }
+    }
+    SweepResult result;
+    result.L1MissRate = caches.level(0).hitMissCalculator();
+    result.L2MissRate = caches.level(1).hitMissCalculator();
+    result.avgAccTime = caches.avgAccessTime();
+    return result;
+}
+
+inline SweepResult sweepRun(const HierarchyConfig& config, const std::vector<SweepAccess>& accesses) {
+    switch (config.replacement) {
+    case REPLACE_PLRU: return sweepRun<PlruReplacement>(config, accesses);
+    case REPLACE_SRRIP: return sweepRun<RripReplacement<RRIP_STATIC>>(config, accesses);
+    case REPLACE_BRRIP: return sweepRun<RripReplacement<RRIP_BIMODAL>>(config, accesses);
+    case REPLACE_DRRIP: return sweepRun<RripReplacement<RRIP_DYNAMIC>>(config, accesses);
+    case REPLACE_RANDOM: return sweepRun<RandomReplacement>(config, accesses);
+    case REPLACE_FIFO: return sweepRun<FifoReplacement>(config, accesses);
+    default: return sweepRun<LruReplacement>(config, accesses);
+    }
+}
+
+// Write the results as CSV, or as a JSON array of objects
+inline void writeSweep(FILE* out, bool json, const std::vector<SweepPoint>& points,
+                       const std::vector<SweepResult>& results) {
+    if (json) {
+        fprintf(out, "[\n");
+    } else {
+        for (unsigned param = 0; param < NUM_SWEEP_PARAMS; ++param) fprintf(out, "%s,", sweepParamName(param));
+        fprintf(out, "L1miss,L2miss,AccTimeAvg\n");
+    }
+    for (size_t i = 0; i < points.size(); ++i) {
+        const SweepPoint& point = points[i];
+        if (json) fprintf(out, "  {");
+        for (unsigned param = 0; param < NUM_SWEEP_PARAMS; ++param) {
+            if (param == SWEEP_REPLACEMENT) {
+                fprintf(out, json ? "\"%s\": \"%s\", " : "%s%s,", json ? sweepParamName(param) : "",
+                        replacementPolicyName(static_cast<ReplacementPolicy>(point.values[param])));
+            } else {
+                fprintf(out, json ? "\"%s\": %u, " : "%s%u,", json ? sweepParamName(param) : "", point.values[param]);
+            }
+        }
+        const SweepResult& result = results[i];
+        if (json) {
+            fprintf(out, "\"L1miss\": %.03f, \"L2miss\": %.03f, \"AccTimeAvg\": %.03f}%s\n", result.L1MissRate,
+                    result.L2MissRate, result.avgAccTime, i + 1 < points.size() ? "," : "");
+        } else {
+            fprintf(out, "%.03f,%.03f,%.03f\n", result.L1MissRate, result.L2MissRate, result.avgAccTime);
+        }
+    }
+    if (json) fprintf(out, "]\n");
+}
+
+#endif
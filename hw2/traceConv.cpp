@@ -0,0 +1,63 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "traceReader.h"
+
+// Convert a memory trace (text or binary) to the binary trace format
+// Usage: ./traceConv <input trace> <binary trace>
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s <input trace> <binary trace>\n", argv[0]);
+		return 1;
+	}
+
+	TraceReader reader;
+	if (!reader.open(argv[1])) {
+		fprintf(stderr, "File not found\n");
+		return 1;
+	}
+	FILE* out = fopen(argv[2], "wb");
+	if (!out) {
+		fprintf(stderr, "Cannot open output file\n");
+		return 1;
+	}
+
+	// The header's count is patched in once every access is written
+	if (!writeBinaryHeader(out, 0)) {
+		fprintf(stderr, "Cannot write output file\n");
+		return 1;
+	}
+	std::vector<unsigned char> chunk;
+	chunk.reserve(1 << 20);
+	uint64_t count = 0;
+	unsigned long int previous = 0;
+	char operation;
+	unsigned long int address;
+	int status;
+	while ((status = reader.next(operation, address)) > 0) {
+		if (operation != 'r' && operation != 'w' && operation != 'i') {
+			fprintf(stderr, "Unknown operation: %c\n", operation);
+			return 1;
+		}
+		encodeBinaryAccess(chunk, operation, address, previous);
+		count++;
+		if (chunk.size() >= (1 << 20) - 16) {
+			if (fwrite(chunk.data(), 1, chunk.size(), out) != chunk.size()) {
+				fprintf(stderr, "Cannot write output file\n");
+				return 1;
+			}
+			chunk.clear();
+		}
+	}
+	if (status < 0) {
+		fprintf(stderr, "Command Format error\n");
+		return 1;
+	}
+	if (fwrite(chunk.data(), 1, chunk.size(), out) != chunk.size() || fseek(out, 0, SEEK_SET) != 0 ||
+			!writeBinaryHeader(out, count) || fclose(out) != 0) {
+		fprintf(stderr, "Cannot write output file\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,185 @@
+#ifndef TRACE_READER_H
+#define TRACE_READER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Memory trace input: the text format ("r 0x1234" / "w 0x1234" / "i 0x1234",
+// one access per line) or the compact binary format below. The file is mapped into memory
+// (or read whole when it cannot be mapped) and parsed in place, so reading an
+// access allocates nothing.
+//
+// Binary format (native byte order for the header):
+//   BinaryTraceHeader
+//   one LEB128 varint per access: (zigzag(address - previous address) << 2) | op
+//   with op 0 for a read, 1 for a write and 2 for an instruction fetch
+// The first access is relative to address 0. Sequential streams take one or
+// two bytes per access. Addresses must be below 2^61.
+// Version 1 traces, which have only a write bit ((zigzag << 1) | write), are
+// still read.
+
+#define BINARY_TRACE_MAGIC "CBTR"
+#define BINARY_TRACE_VERSION 2
+
+struct BinaryTraceHeader {
+    char magic[4];     // BINARY_TRACE_MAGIC
+    uint32_t version;  // BINARY_TRACE_VERSION
+    uint64_t count;    // Number of accesses
+};
+
+class TraceReader {
+public:
+    TraceReader()
+        : data(nullptr), size(0), pos(0), mapped(false), binary(false), opBits(2), remaining(0), previous(0) {}
+
+    ~TraceReader() {
+        if (mapped) munmap(const_cast<unsigned char*>(data), size);
+    }
+
+    // A reader owns its mapping
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    // Open a trace file; false when it cannot be read or has a bad binary header
+    bool open(const char* path) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                madvise(map, st.st_size, MADV_SEQUENTIAL);
+                data = static_cast<const unsigned char*>(map);
+                size = st.st_size;
+                mapped = true;
+            }
+        }
+        if (!mapped) {
+            // Pipes, empty files or no mmap: read everything
+            unsigned char chunk[1 << 16];
+            ssize_t n;
+            while ((n = ::read(fd, chunk, sizeof(chunk))) > 0) {
+                buffer.insert(buffer.end(), chunk, chunk + n);
+            }
+            data = buffer.data();
+            size = buffer.size();
+        }
+        ::close(fd);
+
+        if (size >= sizeof(BinaryTraceHeader) && memcmp(data, BINARY_TRACE_MAGIC, 4) == 0) {
+            BinaryTraceHeader header;
+            memcpy(&header, data, sizeof(header));
+            if (header.version != BINARY_TRACE_VERSION && header.version != 1) return false;
+            binary = true;
+            opBits = header.version == 1 ? 1 : 2;
+            remaining = header.count;
+            pos = sizeof(header);
+        }
+        return true;
+    }
+
+    // Read the next access: 1 when read, 0 at the end of the trace, -1 on a format error
+    int next(char& operation, unsigned long int& address) {
+        return binary ? nextBinary(operation, address) : nextText(operation, address);
+    }
+
+private:
+    const unsigned char* data;  // Whole trace
+    size_t size;
+    size_t pos;                 // Next byte to parse
+    bool mapped;                // data is an mmap of the file, else it points into buffer
+    std::vector<unsigned char> buffer;
+    bool binary;
+    unsigned opBits;            // Bits of the operation below the binary delta
+    uint64_t remaining;         // Binary accesses left
+    unsigned long int previous; // Last binary address
+
+    static bool isBlank(unsigned char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    // Value of a hex digit, or 16 for anything else
+    static unsigned hexDigit(unsigned char c) {
+        unsigned digit = c - static_cast<unsigned>('0');
+        if (digit < 10) return digit;
+        unsigned letter = (c | 0x20u) - static_cast<unsigned>('a');
+        if (letter < 6) return letter + 10;
+        return 16;
+    }
+
+    int nextText(char& operation, unsigned long int& address) {
+        // Skip blank lines
+        while (pos < size && (isBlank(data[pos]) || data[pos] == '\n')) pos++;
+        if (pos == size) return 0;
+        operation = static_cast<char>(data[pos++]);
+        size_t start = pos;
+        while (pos < size && isBlank(data[pos])) pos++;
+        if (pos == start || pos + 2 > size || data[pos] != '0' || (data[pos + 1] | 0x20) != 'x') return -1;
+        pos += 2;
+        unsigned long int value = 0;
+        unsigned digit;
+        size_t digits = pos;
+        while (pos < size && (digit = hexDigit(data[pos])) < 16) {
+            value = (value << 4) | digit;
+            pos++;
+        }
+        if (pos == digits) return -1;
+        // Ignore anything else on the line
+        while (pos < size && data[pos] != '\n') pos++;
+        address = value;
+        return 1;
+    }
+
+    int nextBinary(char& operation, unsigned long int& address) {
+        if (remaining == 0) return 0;
+        uint64_t value = 0;
+        unsigned shift = 0;
+        while (true) {
+            if (pos == size || shift > 63) return -1;
+            unsigned char byte = data[pos++];
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) break;
+            shift += 7;
+        }
+        remaining--;
+        static const char operations[4] = { 'r', 'w', 'i', 0 };
+        operation = operations[value & ((1u << opBits) - 1)];
+        if (!operation) return -1;
+        uint64_t zigzag = value >> opBits;
+        previous += static_cast<unsigned long int>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+        address = previous;
+        return 1;
+    }
+};
+
+// Append one access to a binary trace body; previous is the last address written
+inline void encodeBinaryAccess(std::vector<unsigned char>& out, char operation, unsigned long int address,
+                               unsigned long int& previous) {
+    int64_t delta = static_cast<int64_t>(address - previous);
+    previous = address;
+    uint64_t zigzag = (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63);
+    // The operation takes the top two bits of the zigzag delta: addresses below 2^61 round-trip
+    uint64_t value = (zigzag << 2) | (operation == 'w' ? 1 : operation == 'i' ? 2 : 0);
+    while (value >= 0x80) {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+// Write a binary trace header
+inline bool writeBinaryHeader(FILE* out, uint64_t count) {
+    BinaryTraceHeader header;
+    memcpy(header.magic, BINARY_TRACE_MAGIC, 4);
+    header.version = BINARY_TRACE_VERSION;
+    header.count = count;
+    return fwrite(&header, sizeof(header), 1, out) == 1;
+}
+
+#endif